@@ -0,0 +1,66 @@
+#!/bin/sh
+# Sweep mandelmovie over process/thread counts and kernel variants and
+# collect one CSV row per run (see mandelmovie -B) in $BENCH_CSV.
+#
+#   make bench                                  # defaults below
+#   BENCH_ARGS="-W 3840 -H 2160 -n 60" ./bench.sh
+#   BENCH_BUILDS="all release pgo" ./bench.sh   # also rebuild with each make
+#                                               # target and compare the builds
+set -e
+
+BENCH_CSV=${BENCH_CSV:-bench.csv}
+BENCH_ARGS=${BENCH_ARGS:--W 960 -H 540 -n 48 -m 1000}
+BENCH_BUILDS=${BENCH_BUILDS:-}
+CPUS=$(getconf _NPROCESSORS_ONLN)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+rm -f "$BENCH_CSV"
+run() {
+    echo "mandelmovie $*" >&2
+    ./mandelmovie $BENCH_ARGS -o "$OUT/frame" -B "$BENCH_CSV" "$@" > /dev/null
+}
+
+# Process scaling: 1, 2, 5, 10, 20 like the README's plot, and the CPU count
+for p in 1 2 5 10 20 "$CPUS"; do
+    run -p "$p"
+done
+
+# Threads inside one process, and split between processes and threads
+for t in 2 4 "$CPUS"; do
+    run -p 1 -t "$t"
+done
+if [ "$CPUS" -ge 4 ]; then
+    run -p $((CPUS / 2)) -t 2
+fi
+
+# Kernel variants at full width
+run -p "$CPUS" -k scalar
+run -p "$CPUS" -k scalar -E
+run -p "$CPUS" -E
+run -p "$CPUS" -M
+run -p "$CPUS" -Y
+run -p "$CPUS" -U
+
+# Worker models: threads instead of fork(), with and without NUMA pinning
+run -p "$CPUS" -X
+run -p "$CPUS" -a
+run -p "$CPUS" -X -a
+
+# Builds: the same run with the blocked and the plain kernels per make
+# target, told apart by the build column, then their speedups over the first
+if [ -n "$BENCH_BUILDS" ]; then
+    first=$(($(wc -l < "$BENCH_CSV") + 1))
+    for b in $BENCH_BUILDS; do
+        echo "make $b" >&2
+        make -s clean && make -s "$b" > /dev/null
+        run -p "$CPUS"
+        run -p "$CPUS" -U
+    done
+    awk -F, -v first="$first" 'NR >= first {
+            if (NR == first) base = $17
+            printf "%-8s %-14s %8.2f Mpixel/s %6.2fx\n", $19, $3, $17, $17 / base
+        }' "$BENCH_CSV" >&2
+fi
+
+echo "wrote $BENCH_CSV" >&2
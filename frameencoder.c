@@ -0,0 +1,113 @@
+/**************************************************************
+Filename: frameencoder.c
+Description: Moves JPEG encoding (or streaming) of a frame off
+the thread that computes the frames. A handoff queue connects
+the two: the render threads fill frame N+1 while this thread
+encodes and writes frame N, so the encode time hides behind
+the compute time, which is the larger of the two.
+**************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "frameencoder.h"
+
+#define ENCODER_QUEUE 4                 // Submitted frames not yet stored, more than the pool ever has out
+
+typedef struct encodeTask {
+    imgRawImage *img;
+    int index;
+    char note[64];
+} encodeTask;
+
+struct frameEncoder {
+    imgFramePool *frames;
+    frameStoreFn store;
+    void *context;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;
+    pthread_cond_t taken;
+    encodeTask queue[ENCODER_QUEUE];    // A ring of tasks from head
+    int head;
+    int pending;
+    int shutdown;
+};
+
+static void *encoder_thread(void *arg) {
+    frameEncoder *encoder = arg;
+
+    pthread_mutex_lock(&encoder->lock);
+    for (;;) {
+        while (encoder->pending == 0 && !encoder->shutdown) {
+            pthread_cond_wait(&encoder->submitted, &encoder->lock);
+        }
+        if (encoder->pending == 0) {
+            break;                                                  // Shut down with nothing left to store
+        }
+        encodeTask task = encoder->queue[encoder->head];
+        encoder->head = (encoder->head + 1) % ENCODER_QUEUE;
+        encoder->pending--;
+        pthread_cond_signal(&encoder->taken);
+        pthread_mutex_unlock(&encoder->lock);
+
+        encoder->store(encoder->context, task.img, task.index, task.note);
+        releaseFrame(encoder->frames, task.img);                    // The renderer can fill it again
+
+        pthread_mutex_lock(&encoder->lock);
+    }
+    pthread_mutex_unlock(&encoder->lock);
+    return NULL;
+}
+
+frameEncoder *initFrameEncoder(imgFramePool *frames, frameStoreFn store, void *context) {
+    frameEncoder *encoder = calloc(1, sizeof(frameEncoder));
+    if (encoder == NULL) {
+        return NULL;
+    }
+    encoder->frames = frames;
+    encoder->store = store;
+    encoder->context = context;
+    pthread_mutex_init(&encoder->lock, NULL);
+    pthread_cond_init(&encoder->submitted, NULL);
+    pthread_cond_init(&encoder->taken, NULL);
+    if (pthread_create(&encoder->thread, NULL, encoder_thread, encoder) != 0) {
+        pthread_cond_destroy(&encoder->taken);
+        pthread_cond_destroy(&encoder->submitted);
+        pthread_mutex_destroy(&encoder->lock);
+        free(encoder);
+        return NULL;
+    }
+    return encoder;
+}
+
+void submitFrame(frameEncoder *encoder, imgRawImage *img, int index, const char *note) {
+    pthread_mutex_lock(&encoder->lock);
+    while (encoder->pending == ENCODER_QUEUE) {
+        pthread_cond_wait(&encoder->taken, &encoder->lock);
+    }
+    encodeTask *task = &encoder->queue[(encoder->head + encoder->pending) % ENCODER_QUEUE];
+    task->img = img;
+    task->index = index;
+    strncpy(task->note, note, sizeof(task->note) - 1);
+    task->note[sizeof(task->note) - 1] = '\0';
+    encoder->pending++;
+    pthread_cond_signal(&encoder->submitted);
+    pthread_mutex_unlock(&encoder->lock);
+}
+
+void freeFrameEncoder(frameEncoder *encoder) {
+    if (encoder == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&encoder->lock);
+    encoder->shutdown = 1;
+    pthread_cond_signal(&encoder->submitted);
+    pthread_mutex_unlock(&encoder->lock);
+
+    pthread_join(encoder->thread, NULL);
+    pthread_cond_destroy(&encoder->taken);
+    pthread_cond_destroy(&encoder->submitted);
+    pthread_mutex_destroy(&encoder->lock);
+    free(encoder);
+}
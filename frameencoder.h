@@ -0,0 +1,24 @@
+#ifndef FRAMEENCODER_H
+#define FRAMEENCODER_H
+
+#include "jpegrw.h"
+
+// A thread that stores finished frames while the next one is computed.
+// Frames come from an imgFramePool with at least two buffers, so one can
+// be encoded while the other is filled, and go back to it once stored.
+typedef struct frameEncoder frameEncoder;
+
+// Called on the encoder thread for every frame, in the order they were submitted
+typedef void (*frameStoreFn)(void* context, const imgRawImage* img, int index, const char* note);
+
+// Returns NULL if the thread can't be started
+frameEncoder* initFrameEncoder(imgFramePool* frames, frameStoreFn store, void* context);
+
+// Hand a frame acquired from the pool to the encoder. Only waits if the
+// encoder is still behind on earlier frames.
+void submitFrame(frameEncoder* encoder, imgRawImage* img, int index, const char* note);
+
+// Store the frames still queued, then stop the thread
+void freeFrameEncoder(frameEncoder* encoder);
+
+#endif  /* Compile guard */
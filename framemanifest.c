@@ -0,0 +1,142 @@
+/**************************************************************
+Filename: framemanifest.c
+Description: The checkpoint manifest of mandelmovie. Every frame
+stored is appended to it with its checksum, so a render that is
+killed or preempted part way can be restarted with -r and only
+renders the frames that aren't on disk intact.
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <zlib.h>
+#include "framemanifest.h"
+
+#define MANIFEST_MAGIC "mandelmovie-manifest 1"
+#define MANIFEST_LINE 1024
+
+/*
+Whether fname holds exactly size bytes with the given CRC-32
+*/
+static int file_matches(const char *fname, size_t size, unsigned long crc) {
+    FILE *file = fopen(fname, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    unsigned char buffer[65536];
+    uLong sum = crc32(0L, Z_NULL, 0);
+    size_t total = 0, n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        sum = crc32(sum, buffer, n);
+        total += n;
+    }
+    int ok = !ferror(file) && total == size && sum == crc;
+    fclose(file);
+    return ok;
+}
+
+/*
+Copy the entries of the old manifest whose files still check out into out, marking their frames done
+*/
+static void verify_frames(frameManifest *manifest, FILE *old, FILE *out) {
+    char line[MANIFEST_LINE];
+    while (fgets(line, sizeof(line), old) != NULL) {
+        int i, name;
+        size_t size;
+        unsigned long crc;
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%d %zu %lx %n", &i, &size, &crc, &name) < 3 || i < 0 || i >= manifest->numFrames ||
+            manifest->done[i] || !file_matches(line + name, size, crc)) {
+            continue;                                                       // Torn line, missing or damaged file
+        }
+        manifest->done[i] = 1;
+        manifest->resumed++;
+        fprintf(out, "%s\n", line);
+    }
+}
+
+frameManifest *initFrameManifest(const char *path, const char *fingerprint, int numFrames, int resume) {
+    frameManifest *manifest = calloc(1, sizeof(frameManifest));
+    if (manifest == NULL) {
+        return NULL;
+    }
+    manifest->fd = -1;
+    manifest->numFrames = numFrames;
+    manifest->done = mmap(NULL, numFrames > 0 ? numFrames : 1, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);               // Zeroed, and seen by the parent after fork()
+    if (manifest->done == MAP_FAILED) {
+        free(manifest);
+        return NULL;
+    }
+
+    // Build the new manifest next to the old one and swap it in, so a crash in
+    // between leaves one or the other
+    char tmppath[MANIFEST_LINE];
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+    FILE *out = fopen(tmppath, "w");
+    if (out == NULL) {
+        freeFrameManifest(manifest);
+        return NULL;
+    }
+    fprintf(out, "%s %s\n", MANIFEST_MAGIC, fingerprint);
+
+    FILE *old = resume ? fopen(path, "r") : NULL;
+    if (old != NULL) {
+        char line[MANIFEST_LINE] = "";
+        if (fgets(line, sizeof(line), old) != NULL) {
+            line[strcspn(line, "\n")] = '\0';
+        }
+        if (strncmp(line, MANIFEST_MAGIC " ", strlen(MANIFEST_MAGIC) + 1) == 0 &&
+            strcmp(line + strlen(MANIFEST_MAGIC) + 1, fingerprint) == 0) {
+            verify_frames(manifest, old, out);
+        } else {
+            manifest->stale = 1;                                            // Frames of another render, start over
+        }
+        fclose(old);
+    }
+
+    if (fclose(out) != 0 || rename(tmppath, path) != 0) {
+        unlink(tmppath);
+        freeFrameManifest(manifest);
+        return NULL;
+    }
+    manifest->fd = open(path, O_WRONLY | O_APPEND);
+    if (manifest->fd < 0) {
+        freeFrameManifest(manifest);
+        return NULL;
+    }
+    return manifest;
+}
+
+void freeFrameManifest(frameManifest *manifest) {
+    if (manifest->fd >= 0) {
+        close(manifest->fd);
+    }
+    munmap(manifest->done, manifest->numFrames > 0 ? manifest->numFrames : 1);
+    free(manifest);
+}
+
+int recordManifestFrame(frameManifest *manifest, int i, const char *fname, const unsigned char *data, size_t size) {
+    char line[MANIFEST_LINE];
+    int length = snprintf(line, sizeof(line), "%d %zu %08lx %s\n", i, size,
+                          (unsigned long)crc32(crc32(0L, Z_NULL, 0), data, size), fname);
+    if (length >= sizeof(line)) {
+        return -1;
+    }
+    if (write(manifest->fd, line, length) != length) {                      // One append per line, so the children's lines don't mix
+        return -1;
+    }
+    manifest->done[i] = 1;
+    return 0;
+}
+
+int countMissingFrames(const frameManifest *manifest) {
+    int missing = 0;
+    for (int i = 0; i < manifest->numFrames; ++i) {
+        missing += !manifest->done[i];
+    }
+    return missing;
+}
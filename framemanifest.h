@@ -0,0 +1,37 @@
+#ifndef FRAMEMANIFEST_H
+#define FRAMEMANIFEST_H
+
+#include <stddef.h>
+
+// A record of the frames a movie render has stored, so an interrupted render
+// can be resumed with only the missing frames. The manifest is a text file:
+// a header line naming the render's settings, then one line per stored frame
+// with its size, CRC-32 and file name, appended only after the file is
+// completely written. The children share the descriptor and the done flags
+// across fork().
+typedef struct frameManifest {
+	int fd;                 // opened for appending
+	int numFrames;
+	int resumed;            // frames verified done when the manifest was opened
+	int stale;              // there was a manifest, but from other settings
+	unsigned char* done;    // shared, done[i] is set once frame i is recorded
+} frameManifest;
+
+// Open the manifest at path for a render of numFrames frames, described by
+// fingerprint (one line, no newline). With resume, the frames listed in an
+// existing manifest with the same fingerprint are checked against their
+// files' size and checksum, and the ones that match are marked done - the
+// manifest is rewritten with just those. Otherwise it is started empty.
+// Returns NULL on failure.
+frameManifest* initFrameManifest(const char* path, const char* fingerprint, int numFrames, int resume);
+
+void freeFrameManifest(frameManifest* manifest);
+
+// Record that frame i was stored in fname with the given contents.
+// Returns 0 on success.
+int recordManifestFrame(frameManifest* manifest, int i, const char* fname, const unsigned char* data, size_t size);
+
+// number of frames not done yet
+int countMissingFrames(const frameManifest* manifest);
+
+#endif  /* Compile guard */
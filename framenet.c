@@ -0,0 +1,480 @@
+/**************************************************************
+Filename: framenet.c
+Description: Multi-node rendering for mandelmovie. The coordinator
+hands frames out to workers on other machines over TCP and stores
+the encoded frames they send back, the workers pull a unit, render
+it with the usual per-node processes and threads, and ask for more.
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "framenet.h"
+
+#define NET_VERSION 2                       // 2: frames carry their timing
+#define NET_MAX_WORKERS 256                 // connections the coordinator serves at once
+#define NET_FINGERPRINT_MAX 1024
+#define NET_READ_TIMEOUT 60                 // seconds a worker may stall in the middle of a message
+#define NET_TIMING_BYTES 40                 // the frameTiming fields at the start of a frame's payload
+
+// Messages - each is a header and size bytes of payload
+enum netMessage {
+    NET_HELLO,                              // worker: value is the version, payload the fingerprint
+    NET_REQUEST,                            // worker: wants a unit
+    NET_ASSIGN,                             // coordinator: value is the unit, -1 to stop
+    NET_FRAME,                              // worker: value is the frame, payload its timing and the encoded image
+    NET_REJECT                              // coordinator: the worker renders something else
+};
+
+typedef struct netHeader {
+    uint32_t type;                          // all in network byte order
+    uint32_t value;
+    uint32_t size;
+} netHeader;
+
+// What the coordinator knows about each connection
+typedef struct netClient {
+    int fd;                                 // -1 for a free slot
+    char peer[64];
+    int hello;                              // fingerprint checked
+    int waiting;                            // asked for a unit it hasn't been given yet
+    int stopped;                            // told there is no more work, closes once its encoder drains
+} netClient;
+
+// The coordinator's view of the units
+typedef struct netUnits {
+    const int *units;
+    int numUnits;
+    int framesPerUnit;
+    int numFrames;
+    int next;                               // next unit never handed out
+    int *requeued;                          // units whose workers went away, handed out first
+    int numRequeued;
+    int (*owners)[2];                       // clients rendering each unit, a second one when it was stolen
+    long long *assigned;                    // when each unit was first handed out, the oldest is stolen first
+    long long clock;
+    int *remaining;                         // frames of each unit not received yet
+    int unitsLeft;
+    int *unitIndex;                         // unit number -> index into units, -1 if not served
+    unsigned char *frameDone;
+} netUnits;
+
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;   // A worker sends frames and requests from two threads
+
+static int write_all(int fd, const void *data, size_t size) {
+    const unsigned char *p = data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);              // A peer going away is an error, not SIGPIPE
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t size) {
+    unsigned char *p = data;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int send_message(int fd, int type, int value, const void *data, size_t size) {
+    netHeader header = { htonl(type), htonl((uint32_t)value), htonl((uint32_t)size) };
+    pthread_mutex_lock(&send_lock);
+    int result = write_all(fd, &header, sizeof(header));
+    if (result == 0 && size > 0) {
+        result = write_all(fd, data, size);
+    }
+    pthread_mutex_unlock(&send_lock);
+    return result;
+}
+
+static int read_header(int fd, int *type, int *value, size_t *size) {
+    netHeader header;
+    if (read_all(fd, &header, sizeof(header)) != 0) {
+        return -1;
+    }
+    *type = ntohl(header.type);
+    *value = (int32_t)ntohl(header.value);
+    *size = ntohl(header.size);
+    return 0;
+}
+
+int listenFrameCoordinator(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));       // Restart right away after a crash
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connectFrameCoordinator(const char *address, const char *fingerprint) {
+    char host[256];
+    const char *colon = strrchr(address, ':');
+    if (colon == NULL || colon - address >= (long)sizeof(host)) {
+        errno = EINVAL;
+        return -1;
+    }
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - address), address);
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *found;
+    if (getaddrinfo(host, colon + 1, &hints, &found) != 0) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *a = found; a != NULL && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));     // Requests are tiny and latency bound
+    if (send_message(fd, NET_HELLO, NET_VERSION, fingerprint, strlen(fingerprint)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int requestNetUnit(int fd) {
+    int type, value;
+    size_t size;
+    if (send_message(fd, NET_REQUEST, 0, NULL, 0) != 0 || read_header(fd, &type, &value, &size) != 0) {
+        return -2;
+    }
+    if (type != NET_ASSIGN || size != 0) {
+        return -2;                                                  // NET_REJECT
+    }
+    return value < 0 ? -1 : value;
+}
+
+static void put_u64(unsigned char *p, uint64_t value) {
+    for (int b = 0; b < 8; ++b) {
+        p[b] = value >> (56 - 8 * b);                               // Network byte order
+    }
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int b = 0; b < 8; ++b) {
+        value = value << 8 | p[b];
+    }
+    return value;
+}
+
+int sendNetFrame(int fd, int frame, const frameTiming *timing, const unsigned char *data, size_t size) {
+    if (size > UINT32_MAX - NET_TIMING_BYTES) {
+        return -1;
+    }
+    unsigned char fields[NET_TIMING_BYTES];
+    put_u64(fields, timing->compute_ns);
+    put_u64(fields + 8, timing->encode_ns);
+    put_u64(fields + 16, timing->iterations);
+    put_u64(fields + 24, timing->max_pixels);
+    uint32_t small[2] = { htonl((uint32_t)timing->max), htonl((uint32_t)timing->precision) };
+    memcpy(fields + 32, small, sizeof(small));
+
+    netHeader header = { htonl(NET_FRAME), htonl((uint32_t)frame), htonl((uint32_t)(NET_TIMING_BYTES + size)) };
+    pthread_mutex_lock(&send_lock);
+    int result = write_all(fd, &header, sizeof(header));
+    if (result == 0) {
+        result = write_all(fd, fields, sizeof(fields));
+    }
+    if (result == 0 && size > 0) {
+        result = write_all(fd, data, size);
+    }
+    pthread_mutex_unlock(&send_lock);
+    return result;
+}
+
+/*
+Close a connection and put the units it held back in the queue, unless another worker still has them
+*/
+static void drop_client(netClient *clients, int c, netUnits *u) {
+    close(clients[c].fd);
+    clients[c].fd = -1;
+    for (int k = 0; k < u->numUnits; ++k) {
+        if (u->remaining[k] == 0 || (u->owners[k][0] != c && u->owners[k][1] != c)) {
+            continue;
+        }
+        if (u->owners[k][0] == c) {
+            u->owners[k][0] = u->owners[k][1];
+        }
+        u->owners[k][1] = -1;
+        if (u->owners[k][0] < 0) {
+            u->requeued[u->numRequeued++] = k;
+            printf("Requeued: unit %d from %s\n", u->units[k], clients[c].peer);
+        }
+    }
+}
+
+/*
+Answer a waiting client: a requeued or fresh unit, else a copy of the oldest unit that only one other
+client is rendering, else the stop once everything is in. With none of those it keeps waiting.
+*/
+static void dispatch(netClient *clients, int c, netUnits *u) {
+    int k = -1;
+    if (u->numRequeued > 0) {
+        k = u->requeued[--u->numRequeued];
+    } else if (u->next < u->numUnits) {
+        k = u->next++;
+    } else {
+        for (int s = 0; s < u->numUnits; ++s) {
+            if (u->remaining[s] > 0 && u->owners[s][1] < 0 && u->owners[s][0] != c &&
+                (k < 0 || u->assigned[s] < u->assigned[k])) {
+                k = s;
+            }
+        }
+        if (k < 0 && u->unitsLeft > 0) {
+            return;
+        }
+    }
+
+    int value = k < 0 ? -1 : u->units[k];
+    if (k >= 0) {
+        u->owners[k][u->owners[k][0] < 0 ? 0 : 1] = c;
+        if (u->assigned[k] == 0) {
+            u->assigned[k] = ++u->clock;
+        }
+    }
+    clients[c].waiting = 0;
+    clients[c].stopped = k < 0;
+    if (send_message(clients[c].fd, NET_ASSIGN, value, NULL, 0) != 0) {
+        drop_client(clients, c, u);
+    }
+}
+
+/*
+Read one message from client c and act on it. Returns -1 if storing a frame failed.
+*/
+static int serve_client(netClient *clients, int c, netUnits *u, const char *fingerprint, netStoreFn store, void *context) {
+    int type, value;
+    size_t size;
+    if (read_header(clients[c].fd, &type, &value, &size) != 0) {
+        if (!clients[c].stopped) {
+            fprintf(stderr, "Warning: Lost worker %s.\n", clients[c].peer);
+        }
+        drop_client(clients, c, u);
+        return 0;
+    }
+
+    if (type == NET_HELLO && !clients[c].hello && size <= NET_FINGERPRINT_MAX) {
+        char theirs[NET_FINGERPRINT_MAX + 1];
+        if (read_all(clients[c].fd, theirs, size) != 0) {
+            drop_client(clients, c, u);
+            return 0;
+        }
+        theirs[size] = '\0';
+        if (value != NET_VERSION || strcmp(theirs, fingerprint) != 0) {
+            fprintf(stderr, "Warning: Rejected worker %s, it renders with other settings.\n", clients[c].peer);
+            send_message(clients[c].fd, NET_REJECT, 0, NULL, 0);
+            drop_client(clients, c, u);
+            return 0;
+        }
+        clients[c].hello = 1;
+        printf("Worker connected: %s\n", clients[c].peer);
+        return 0;
+    }
+    if (type == NET_REQUEST && clients[c].hello && size == 0) {
+        clients[c].waiting = 1;                                     // Answered by the dispatch after every event
+        return 0;
+    }
+    if (type != NET_FRAME || !clients[c].hello || size < NET_TIMING_BYTES) {
+        fprintf(stderr, "Warning: Dropping worker %s, it sent an unexpected message.\n", clients[c].peer);
+        drop_client(clients, c, u);
+        return 0;
+    }
+
+    unsigned char fields[NET_TIMING_BYTES];
+    size -= NET_TIMING_BYTES;
+    unsigned char *data = malloc(size > 0 ? size : 1);
+    if (data == NULL || read_all(clients[c].fd, fields, sizeof(fields)) != 0 || read_all(clients[c].fd, data, size) != 0) {
+        free(data);
+        fprintf(stderr, "Warning: Lost worker %s in the middle of a frame.\n", clients[c].peer);
+        drop_client(clients, c, u);
+        return 0;
+    }
+    int k = value >= 0 && value < u->numFrames ? u->unitIndex[value / u->framesPerUnit] : -1;
+    if (k >= 0 && !u->frameDone[value]) {                           // The second copy of a stolen unit is dropped
+        uint32_t small[2];
+        memcpy(small, fields + 32, sizeof(small));
+        frameTiming timing = {
+            .compute_ns = get_u64(fields),
+            .encode_ns = get_u64(fields + 8),
+            .iterations = get_u64(fields + 16),
+            .max_pixels = get_u64(fields + 24),
+            .max = (int32_t)ntohl(small[0]),
+            .precision = (int32_t)ntohl(small[1]),
+            .worker = c,
+        };
+        if (store(context, value, data, size, &timing, clients[c].peer) != 0) {
+            free(data);
+            return -1;
+        }
+        u->frameDone[value] = 1;
+        if (--u->remaining[k] == 0) {
+            u->unitsLeft--;
+            u->owners[k][0] = u->owners[k][1] = -1;
+        }
+    }
+    free(data);
+    return 0;
+}
+
+int runFrameCoordinator(int listen_fd, const char *fingerprint, const int *units, int numUnits,
+                        int framesPerUnit, int numFrames, netStoreFn store, void *context) {
+    int numUnitIds = (numFrames + framesPerUnit - 1) / framesPerUnit;
+    netUnits u = {
+        .units = units,
+        .numUnits = numUnits,
+        .framesPerUnit = framesPerUnit,
+        .numFrames = numFrames,
+        .requeued = malloc(sizeof(int) * (numUnits > 0 ? numUnits : 1)),
+        .owners = malloc(sizeof(int[2]) * (numUnits > 0 ? numUnits : 1)),
+        .assigned = calloc(numUnits > 0 ? numUnits : 1, sizeof(long long)),
+        .remaining = malloc(sizeof(int) * (numUnits > 0 ? numUnits : 1)),
+        .unitsLeft = numUnits,
+        .unitIndex = malloc(sizeof(int) * (numUnitIds > 0 ? numUnitIds : 1)),
+        .frameDone = calloc(numFrames > 0 ? numFrames : 1, 1),
+    };
+    netClient *clients = malloc(sizeof(netClient) * NET_MAX_WORKERS);
+    int result = -1;
+    if (u.requeued == NULL || u.owners == NULL || u.assigned == NULL || u.remaining == NULL || u.unitIndex == NULL ||
+        u.frameDone == NULL || clients == NULL) {
+        goto done;
+    }
+    for (int id = 0; id < numUnitIds; ++id) {
+        u.unitIndex[id] = -1;
+    }
+    for (int k = 0; k < numUnits; ++k) {
+        int first = units[k] * framesPerUnit;
+        u.remaining[k] = (first + framesPerUnit < numFrames ? first + framesPerUnit : numFrames) - first;
+        u.owners[k][0] = u.owners[k][1] = -1;
+        u.unitIndex[units[k]] = k;
+    }
+    for (int c = 0; c < NET_MAX_WORKERS; ++c) {
+        clients[c].fd = -1;
+    }
+
+    struct pollfd fds[NET_MAX_WORKERS + 1];
+    int slot[NET_MAX_WORKERS + 1];
+    result = 0;
+    for (;;) {
+        int connected = 0;
+        for (int c = 0; c < NET_MAX_WORKERS; ++c) {
+            if (clients[c].fd >= 0 && clients[c].waiting) {
+                dispatch(clients, c, &u);
+            }
+            connected += clients[c].fd >= 0;
+        }
+        if (u.unitsLeft == 0 && connected == 0) {
+            break;                                                  // Every frame is in and every worker told to stop
+        }
+
+        int n = 0;
+        fds[n++] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+        for (int c = 0; c < NET_MAX_WORKERS; ++c) {
+            if (clients[c].fd >= 0) {
+                slot[n] = c;
+                fds[n++] = (struct pollfd){ .fd = clients[c].fd, .events = POLLIN };
+            }
+        }
+        if (poll(fds, n, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            struct sockaddr_storage addr;
+            socklen_t length = sizeof(addr);
+            int fd = accept(listen_fd, (struct sockaddr *)&addr, &length);
+            int c = 0;
+            while (c < NET_MAX_WORKERS && clients[c].fd >= 0) {
+                c++;
+            }
+            if (fd >= 0 && c == NET_MAX_WORKERS) {
+                close(fd);                                          // Full, the worker finds out on its first request
+            } else if (fd >= 0) {
+                struct timeval timeout = { NET_READ_TIMEOUT, 0 };
+                int on = 1;
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));  // Notice nodes that vanish
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                clients[c] = (netClient){ .fd = fd };
+                if (getnameinfo((struct sockaddr *)&addr, length, clients[c].peer, sizeof(clients[c].peer),
+                                NULL, 0, NI_NUMERICHOST) != 0) {
+                    strcpy(clients[c].peer, "unknown");
+                }
+            }
+        }
+        for (int i = 1; i < n && result == 0; ++i) {
+            if (fds[i].revents != 0 && clients[slot[i]].fd == fds[i].fd &&
+                serve_client(clients, slot[i], &u, fingerprint, store, context) != 0) {
+                result = -1;
+            }
+        }
+        if (result != 0) {
+            break;
+        }
+    }
+    for (int c = 0; c < NET_MAX_WORKERS; ++c) {
+        if (clients[c].fd >= 0) {
+            close(clients[c].fd);
+        }
+    }
+
+done:
+    free(clients);
+    free(u.frameDone);
+    free(u.unitIndex);
+    free(u.remaining);
+    free(u.assigned);
+    free(u.owners);
+    free(u.requeued);
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef FRAMENET_H
+#define FRAMENET_H
+
+#include <stddef.h>
+#include "frametiming.h"
+
+// Rendering a movie on several machines. A coordinator hands out units of
+// work (frames, or keyframe groups) over TCP one at a time to the workers
+// that ask for one, and the workers send each finished frame back encoded.
+// A unit held by a worker whose connection drops goes back in the queue,
+// and once the queue is empty an idle worker gets a second copy of a unit
+// still in flight, so one slow node doesn't hold up the end of the movie.
+// Both sides must render with the same settings, which the workers prove
+// by sending the coordinator their fingerprint of them when they connect.
+
+// listen for workers on port - returns the socket, or -1 on failure
+int listenFrameCoordinator(int port);
+
+// What the coordinator does with a frame it receives, along with the
+// worker's timing of it. The timing's worker is the number of the
+// connection it came in on. Returns 0 on success.
+typedef int (*netStoreFn)(void* context, int frame, const unsigned char* data, size_t size,
+						  const frameTiming* timing, const char* peer);
+
+// Serve the units until every frame of them has been received, then tell
+// the workers to stop. Unit u covers frames u*framesPerUnit up to
+// numFrames. Returns 0 once all units are done, -1 if the coordinator fails.
+int runFrameCoordinator(int listen_fd, const char* fingerprint, const int* units, int numUnits,
+						int framesPerUnit, int numFrames, netStoreFn store, void* context);
+
+// Connect to a coordinator at host:port and introduce the worker by its
+// fingerprint. Returns the connection, or -1 on failure.
+int connectFrameCoordinator(const char* address, const char* fingerprint);
+
+// Ask for the next unit to render. Returns it, -1 when there is no more
+// work, or -2 if the coordinator refused the worker or went away.
+int requestNetUnit(int fd);
+
+// send an encoded frame back with its compute and encode times, iteration
+// totals and precision from timing - safe to call from another thread than
+// requestNetUnit. Returns 0 on success.
+int sendNetFrame(int fd, int frame, const frameTiming* timing, const unsigned char* data, size_t size);
+
+#endif  /* Compile guard */
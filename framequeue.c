@@ -0,0 +1,72 @@
+/**************************************************************
+Filename: framequeue.c
+Description: A work queue of frame numbers shared between the
+forked children of mandelmovie. Each child pulls the next frame
+from an atomic counter, so nobody sits idle while another child
+is still working through a long block of deep-zoom frames.
+**************************************************************/
+
+#include <string.h>
+#include <sys/mman.h>
+#include "framequeue.h"
+
+static size_t queue_bytes(int numFrames) {
+    return sizeof(frameQueue) + sizeof(int) * (size_t)numFrames;
+}
+
+int parseSchedMode(const char *name) {
+    if (strcmp(name, "static") == 0) return SCHED_STATIC;
+    if (strcmp(name, "dynamic") == 0) return SCHED_DYNAMIC;
+    if (strcmp(name, "lpt") == 0) return SCHED_LPT;
+    return -1;
+}
+
+const char *schedModeName(schedMode mode) {
+    switch (mode) {
+        case SCHED_STATIC:  return "static";
+        case SCHED_DYNAMIC: return "dynamic";
+        case SCHED_LPT:     return "lpt";
+    }
+    return "unknown";
+}
+
+frameQueue *initFrameQueue(int numFrames, schedMode mode, const double *costs) {
+    frameQueue *queue = mmap(NULL, queue_bytes(numFrames), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (queue == MAP_FAILED) {
+        return NULL;
+    }
+
+    queue->numFrames = numFrames;
+    queue->next = 0;
+    for (int i = 0; i < numFrames; ++i) {
+        // Frames get more expensive as the zoom deepens, so the
+        // longest-processing-time order is simply the reverse.
+        queue->order[i] = (mode == SCHED_LPT) ? numFrames - 1 - i : i;
+    }
+    if (mode == SCHED_LPT && costs != NULL) {
+        // Insertion sort into descending predicted cost. The reverse order
+        // above is already close, and ties stay deepest first.
+        for (int i = 1; i < numFrames; ++i) {
+            int frame = queue->order[i];
+            int j = i;
+            for (; j > 0 && costs[queue->order[j - 1]] < costs[frame]; --j) {
+                queue->order[j] = queue->order[j - 1];
+            }
+            queue->order[j] = frame;
+        }
+    }
+    return queue;
+}
+
+void freeFrameQueue(frameQueue *queue) {
+    munmap(queue, queue_bytes(queue->numFrames));
+}
+
+int popFrameQueue(frameQueue *queue) {
+    int slot = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+    if (slot >= queue->numFrames) {
+        return -1;
+    }
+    return queue->order[slot];
+}
@@ -0,0 +1,33 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+// How frames are handed out to the workers
+typedef enum schedMode {
+	SCHED_STATIC,   // fixed contiguous block of frames per worker
+	SCHED_DYNAMIC,  // next frame index pulled from a shared counter
+	SCHED_LPT       // like dynamic, but the most expensive frames go first -
+	                // by predicted cost when there is one, else the deepest first
+} schedMode;
+
+// a frame queue living in shared memory so it is visible across fork()
+typedef struct frameQueue {
+	int numFrames;
+	int next;       // index into order[], only touched atomically
+	int order[];    // frame numbers in dispatch order
+} frameQueue;
+
+// parse "static", "dynamic" or "lpt" - returns -1 if unknown
+int parseSchedMode(const char* name);
+
+const char* schedModeName(schedMode mode);
+
+// allocates the queue in anonymous shared memory - NULL on failure
+// costs may be NULL, otherwise SCHED_LPT hands frames out in descending cost
+frameQueue* initFrameQueue(int numFrames, schedMode mode, const double* costs);
+
+void freeFrameQueue(frameQueue* queue);
+
+// returns the next frame number to render, or -1 once the queue is drained
+int popFrameQueue(frameQueue* queue);
+
+#endif  /* Compile guard */
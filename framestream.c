@@ -0,0 +1,229 @@
+/**************************************************************
+Filename: framestream.c
+Description: Streams the raw RGB frames of a movie, in order, to a
+single output (stdout or a named pipe feeding ffmpeg -f rawvideo),
+instead of a JPEG file per frame. Children finish frames out of
+order, so the parent keeps a small reorder buffer between their
+pipes and the output. The output can also be an ffmpeg process
+started here, which encodes the movie as the frames arrive.
+**************************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "framestream.h"
+
+// Sent ahead of every frame's pixels
+typedef struct streamHeader {
+    int index;
+    unsigned int width;
+    unsigned int height;
+} streamHeader;
+
+// A child's pipe as seen by the parent
+typedef struct streamSource {
+    int fd;
+    int open;
+    int pending;                // header read, pixels not yet
+    streamHeader header;
+} streamSource;
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Returns 1 when all len bytes were read, 0 on end of file, -1 on error
+static int read_all(int fd, void *buf, size_t len) {
+    unsigned char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return p == (unsigned char *)buf ? 0 : -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
+int sendStreamFrame(int fd, int index, const imgRawImage *img) {
+    streamHeader header = { index, img->width, img->height };
+    if (write_all(fd, &header, sizeof(header)) < 0) {
+        return -1;
+    }
+    return write_all(fd, img->lpData, (size_t)img->width * img->height * img->numComponents);
+}
+
+int runFrameStream(int out_fd, const int *child_fds, int num_children, int num_frames, int max_buffered) {
+    streamSource *sources = calloc(num_children, sizeof(streamSource));
+    struct pollfd *polls = calloc(num_children, sizeof(struct pollfd));
+    unsigned char **frames = calloc(num_frames, sizeof(unsigned char *));
+    size_t *sizes = calloc(num_frames, sizeof(size_t));
+    int next = 0;
+    int buffered = 0;
+    int open_sources = num_children;
+
+    for (int c = 0; c < num_children; ++c) {
+        sources[c].fd = child_fds[c];
+        sources[c].open = 1;
+    }
+
+    while (next < num_frames && open_sources > 0) {
+        // Read pixels for every pending header that can be taken now
+        int progress = 0;
+        for (int c = 0; c < num_children; ++c) {
+            streamSource *src = &sources[c];
+            if (!src->pending || (src->header.index != next && buffered >= max_buffered)) {
+                continue;
+            }
+            size_t size = (size_t)src->header.width * src->header.height * 3;
+            unsigned char *data = malloc(size);
+            if (data == NULL || read_all(src->fd, data, size) != 1) {
+                fprintf(stderr, "mandelmovie: lost frame %d from a child\n", src->header.index);
+                free(data);
+                src->open = 0;
+                src->pending = 0;
+                open_sources--;
+                continue;
+            }
+            frames[src->header.index] = data;
+            sizes[src->header.index] = size;
+            buffered++;
+            src->pending = 0;
+            progress = 1;
+        }
+
+        // Write out everything that is now in order
+        while (next < num_frames && frames[next] != NULL) {
+            if (write_all(out_fd, frames[next], sizes[next]) < 0) {
+                perror("mandelmovie: stream output");
+                goto done;
+            }
+            free(frames[next]);
+            frames[next] = NULL;
+            buffered--;
+            next++;
+            progress = 1;
+        }
+        if (progress) {
+            continue;
+        }
+
+        // Wait for the next header from any child that isn't holding one
+        int num_polls = 0;
+        for (int c = 0; c < num_children; ++c) {
+            if (sources[c].open && !sources[c].pending) {
+                polls[num_polls].fd = sources[c].fd;
+                polls[num_polls].events = POLLIN;
+                num_polls++;
+            }
+        }
+        if (num_polls == 0) {
+            // Every child holds a frame that doesn't fit - take one anyway rather than deadlock
+            max_buffered++;
+            continue;
+        }
+        if (poll(polls, num_polls, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("mandelmovie: poll");
+            break;
+        }
+        for (int k = 0, c = 0; k < num_polls; ++k) {
+            while (sources[c].fd != polls[k].fd) {
+                c++;
+            }
+            if (!(polls[k].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            streamSource *src = &sources[c];
+            int got = read_all(src->fd, &src->header, sizeof(src->header));
+            if (got == 1 && src->header.index >= 0 && src->header.index < num_frames) {
+                src->pending = 1;
+            } else {
+                src->open = 0;                                  // child finished or died
+                open_sources--;
+            }
+        }
+    }
+
+done:
+    if (next < num_frames) {
+        fprintf(stderr, "mandelmovie: stream stopped after %d of %d frames\n", next, num_frames);
+    }
+    for (int f = 0; f < num_frames; ++f) {
+        free(frames[f]);
+    }
+    free(sizes);
+    free(frames);
+    free(polls);
+    free(sources);
+    return next;
+}
+
+int startVideoEncoder(const char *path, const char *codec, int width, int height, int fps, pid_t *pid) {
+    char size[32], rate[16];
+    snprintf(size, sizeof(size), "%dx%d", width, height);
+    snprintf(rate, sizeof(rate), "%d", fps);
+    const char *ffmpeg = getenv("MANDEL_FFMPEG") ? getenv("MANDEL_FFMPEG") : "ffmpeg";
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        return -1;
+    }
+    fflush(stdout);                                 // Don't let the encoder inherit unflushed output
+    if ((*pid = fork()) < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (*pid == 0) {
+        dup2(fds[0], STDIN_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        int crf = strstr(codec, "265") || strstr(codec, "hevc") ? 22 : 18;    // About the same quality for either
+        char crf_arg[8];
+        snprintf(crf_arg, sizeof(crf_arg), "%d", crf);
+        execlp(ffmpeg, ffmpeg, "-loglevel", "error", "-y",
+               "-f", "rawvideo", "-pix_fmt", "rgb24", "-s", size, "-framerate", rate, "-i", "-",
+               "-c:v", codec, "-pix_fmt", "yuv420p", "-crf", crf_arg, path, (char *)NULL);
+        fprintf(stderr, "mandelmovie: can't run %s: %s\n", ffmpeg, strerror(errno));
+        _exit(127);
+    }
+    close(fds[0]);
+    return fds[1];
+}
+
+int finishVideoEncoder(int fd, pid_t pid) {
+    close(fd);                                      // End of input, ffmpeg finishes the file
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
@@ -0,0 +1,29 @@
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <sys/types.h>
+#include "jpegrw.h"
+
+// Send a finished frame from a child to the parent over a pipe.
+// Returns 0 on success.
+int sendStreamFrame(int fd, int index, const imgRawImage* img);
+
+// Collect the frames sent on the children's pipes and write them to out_fd
+// as raw RGB in frame order, holding frames that arrive early in a reorder
+// buffer of at most max_buffered frames. A child whose next frame doesn't
+// fit is left blocked on its pipe until the frames before it are written.
+// Returns the number of frames written.
+int runFrameStream(int out_fd, const int* child_fds, int num_children, int num_frames, int max_buffered);
+
+// Start an ffmpeg process that reads raw RGB frames of the given size from a
+// pipe and encodes them with codec (libx264, libx265, ...) into path, so a
+// movie comes out of one run without intermediate image files. The ffmpeg
+// binary is looked up on PATH, or taken from $MANDEL_FFMPEG. Returns the
+// write end of the pipe, or -1 if the process can't be started.
+int startVideoEncoder(const char* path, const char* codec, int width, int height, int fps, pid_t* pid);
+
+// Close the pipe and wait for the encoder to finish writing the movie.
+// Returns 0 if it succeeded.
+int finishVideoEncoder(int fd, pid_t pid);
+
+#endif  /* Compile guard */
@@ -0,0 +1,75 @@
+/**************************************************************
+Filename: frametiming.c
+Description: Per-frame timings of mandelmovie, recorded by the
+children in a table shared across fork() and summed up by the
+parent for benchmark reports and the per-frame stats output.
+**************************************************************/
+
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "frametiming.h"
+#include "kernel.h"
+
+frameTiming *initFrameTimings(int numFrames) {
+    frameTiming *timings = mmap(NULL, sizeof(frameTiming) * (numFrames > 0 ? numFrames : 1), PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);          // Anonymous mappings start zeroed
+    return timings == MAP_FAILED ? NULL : timings;
+}
+
+void freeFrameTimings(frameTiming *timings, int numFrames) {
+    munmap(timings, sizeof(frameTiming) * (numFrames > 0 ? numFrames : 1));
+}
+
+long long monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void writeFrameTimings(FILE *out, const frameTiming *timings, int numFrames, int csv) {
+    if (csv) {
+        fprintf(out, "frame,worker,max,compute_ns,encode_ns,write_ns,iterations,predicted_iterations,max_pixels,precision\n");
+    }
+    int num_workers = 0;
+    for (int i = 0; i < numFrames; ++i) {
+        const frameTiming *t = &timings[i];
+        fprintf(out, csv ? "%d,%d,%d,%lld,%lld,%lld,%lld,%lld,%ld,%s\n"
+                         : "{\"frame\":%d,\"worker\":%d,\"max\":%d,\"compute_ns\":%lld,\"encode_ns\":%lld,\"write_ns\":%lld,"
+                           "\"iterations\":%lld,\"predicted_iterations\":%lld,\"max_pixels\":%ld,\"precision\":\"%s\"}\n",
+                i, t->worker, t->max, t->compute_ns, t->encode_ns, t->write_ns, t->iterations, t->predicted, t->max_pixels,
+                precisionName(t->precision));
+        if (t->worker >= num_workers) {
+            num_workers = t->worker + 1;
+        }
+    }
+    if (csv || num_workers == 0) {
+        return;
+    }
+
+    frameTiming *sums = calloc(num_workers, sizeof(frameTiming));
+    int *frames = calloc(num_workers, sizeof(int));
+    if (sums == NULL || frames == NULL) {
+        free(frames);
+        free(sums);
+        return;
+    }
+    for (int i = 0; i < numFrames; ++i) {
+        frameTiming *sum = &sums[timings[i].worker];
+        sum->compute_ns += timings[i].compute_ns;
+        sum->encode_ns += timings[i].encode_ns;
+        sum->write_ns += timings[i].write_ns;
+        sum->iterations += timings[i].iterations;
+        sum->predicted += timings[i].predicted;
+        sum->max_pixels += timings[i].max_pixels;
+        frames[timings[i].worker]++;
+    }
+    for (int w = 0; w < num_workers; ++w) {
+        fprintf(out, "{\"worker\":%d,\"frames\":%d,\"compute_ns\":%lld,\"encode_ns\":%lld,\"write_ns\":%lld,"
+                     "\"iterations\":%lld,\"predicted_iterations\":%lld,\"max_pixels\":%ld}\n",
+                w, frames[w], sums[w].compute_ns, sums[w].encode_ns, sums[w].write_ns, sums[w].iterations,
+                sums[w].predicted, sums[w].max_pixels);
+    }
+    free(frames);
+    free(sums);
+}
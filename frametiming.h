@@ -0,0 +1,33 @@
+#ifndef FRAMETIMING_H
+#define FRAMETIMING_H
+
+#include <stdio.h>
+
+// Where the time of each frame went. The table lives in shared memory so
+// the children fill in their frames and the parent reads them after the
+// children exit - every frame is only written by the child rendering it.
+typedef struct frameTiming {
+	long long compute_ns;   // iterating and coloring
+	long long encode_ns;    // encoding the image in memory
+	long long write_ns;     // writing it out, or streaming it to the parent
+	long long iterations;   // sum of the iteration counts of its pixels
+	long long predicted;    // iterations the cost predictor expected, 0 without one
+	long max_pixels;        // pixels that ran to max iterations
+	int max;                // the frame's iteration cap
+	int worker;             // the child that rendered it
+	int precision;          // the precisionType it was iterated with
+} frameTiming;
+
+// allocates a zeroed table for numFrames frames that survives fork() - NULL on failure
+frameTiming* initFrameTimings(int numFrames);
+
+void freeFrameTimings(frameTiming* timings, int numFrames);
+
+// Write one record per frame to out, as JSON lines or as CSV with a header,
+// and with JSON a summary record per worker after the frames
+void writeFrameTimings(FILE* out, const frameTiming* timings, int numFrames, int csv);
+
+// CLOCK_MONOTONIC in nanoseconds
+long long monotonicNs(void);
+
+#endif  /* Compile guard */
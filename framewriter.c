@@ -0,0 +1,569 @@
+/**************************************************************
+Filename: framewriter.c
+Description: Background writes of mandelmovie's encoded frames.
+Each frame file is opened, written as one vectored write and
+closed by three requests in turn on an io_uring submission queue
+shared by up to depth files. The completions are collected the
+next time a frame is queued, so the encoder carries on while the
+storage catches up, and never waits on the filesystem itself. The
+ring is set up with the raw io_uring system calls, no liburing
+needed. Kernels without io_uring, without its open and close
+requests (before 5.6), or where it is switched off get a thread
+doing the same opens, writes and closes one file at a time. With
+O_DIRECT the frame is copied into an aligned buffer and its whole
+blocks are written directly. The tail under a block, and the whole
+frame when the filesystem refuses O_DIRECT, go through the page
+cache instead.
+**************************************************************/
+
+#define _GNU_SOURCE                     // O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "framewriter.h"
+#include "frametiming.h"
+
+#define DIRECT_ALIGN 4096               // O_DIRECT buffer, offset and length alignment
+#define ENTER_RETRIES 100               // Submissions tried on EAGAIN or EBUSY before a request fails
+
+// What an io_uring slot has in the ring
+typedef enum { STAGE_OPEN, STAGE_WRITE, STAGE_CLOSE } writeStage;
+
+// One file being written
+typedef struct writeSlot {
+    int busy;
+    int fd;                             // -1 until opened
+    int index;
+    unsigned char *data;                // The frame, aligned to DIRECT_ALIGN with O_DIRECT
+    size_t size;                        // Bytes of the frame
+    size_t done;                        // Bytes written so far
+    int direct;                         // Writing with O_DIRECT
+    int error;                          // errno value of the first failure, 0 for none
+    struct iovec iov;                   // What the queued write covers, read by the kernel
+    writeStage stage;                   // io_uring only: the request in the ring,
+    int reaped;                         // which came back with result
+    int result;
+    long long start_ns;
+    char path[PATH_MAX];
+    char note[64];
+} writeSlot;
+
+// The mapped submission and completion rings
+typedef struct uringQueue {
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+} uringQueue;
+
+struct frameWriter {
+    int depth;
+    int direct;
+    frameWrittenFn written;
+    void *context;
+    writeSlot *slots;
+    int in_flight;                      // Busy slots
+    int in_ring;                        // Writes the kernel has taken and not yet completed
+    int uring;                          // io_uring, or else the writer thread
+    uringQueue ring;
+    pthread_t thread;                   // Thread backend only:
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int *order;                         // the queued slots, oldest first
+    int head;
+    int count;
+    int shutdown;
+};
+
+/*
+Create the ring and map its queues. Returns 0 on success.
+*/
+static int init_uring(uringQueue *q, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    q->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (q->fd < 0) {
+        return -1;                                                      // ENOSYS, or disabled by the administrator
+    }
+
+    q->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    q->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (q->cq_ring_size > q->sq_ring_size) {
+            q->sq_ring_size = q->cq_ring_size;
+        }
+        q->cq_ring_size = q->sq_ring_size;
+    }
+    q->sq_ring = mmap(NULL, q->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->fd, IORING_OFF_SQ_RING);
+    if (q->sq_ring == MAP_FAILED) {
+        close(q->fd);
+        return -1;
+    }
+    q->cq_ring = q->sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        q->cq_ring = mmap(NULL, q->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->fd,
+                          IORING_OFF_CQ_RING);
+    }
+    q->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    q->sqes = mmap(NULL, q->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, q->fd, IORING_OFF_SQES);
+    if (q->cq_ring == MAP_FAILED || q->sqes == MAP_FAILED) {
+        if (q->sqes != MAP_FAILED) {
+            munmap(q->sqes, q->sqes_size);
+        }
+        if (q->cq_ring != MAP_FAILED && q->cq_ring != q->sq_ring) {
+            munmap(q->cq_ring, q->cq_ring_size);
+        }
+        munmap(q->sq_ring, q->sq_ring_size);
+        close(q->fd);
+        return -1;
+    }
+
+    q->sq_head = (unsigned *)((char *)q->sq_ring + params.sq_off.head);
+    q->sq_tail = (unsigned *)((char *)q->sq_ring + params.sq_off.tail);
+    q->sq_mask = (unsigned *)((char *)q->sq_ring + params.sq_off.ring_mask);
+    q->sq_array = (unsigned *)((char *)q->sq_ring + params.sq_off.array);
+    q->cq_head = (unsigned *)((char *)q->cq_ring + params.cq_off.head);
+    q->cq_tail = (unsigned *)((char *)q->cq_ring + params.cq_off.tail);
+    q->cq_mask = (unsigned *)((char *)q->cq_ring + params.cq_off.ring_mask);
+    q->cqes = (struct io_uring_cqe *)((char *)q->cq_ring + params.cq_off.cqes);
+    return 0;
+}
+
+/*
+Whether the ring's kernel has the requests a frame needs
+*/
+static int uring_has_ops(uringQueue *q) {
+    static const int ops[] = { IORING_OP_OPENAT, IORING_OP_WRITEV, IORING_OP_CLOSE };
+    struct io_uring_probe *probe = calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    if (probe == NULL) {
+        return 0;
+    }
+    int supported = syscall(__NR_io_uring_register, q->fd, IORING_REGISTER_PROBE, probe, 256) == 0;  // EINVAL before 5.6
+    for (int i = 0; supported && i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        supported = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return supported;
+}
+
+static void free_uring(uringQueue *q) {
+    munmap(q->sqes, q->sqes_size);
+    if (q->cq_ring != q->sq_ring) {
+        munmap(q->cq_ring, q->cq_ring_size);
+    }
+    munmap(q->sq_ring, q->sq_ring_size);
+    close(q->fd);
+}
+
+/*
+Move the results of the finished io_uring writes to their slots. Never queues anything, so
+submit_slot() can call it while its own entry is still waiting.
+*/
+static void collect_completions(frameWriter *writer) {
+    uringQueue *q = &writer->ring;
+    unsigned head = *q->cq_head;
+    while (head != __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &q->cqes[head & *q->cq_mask];
+        writeSlot *slot = &writer->slots[cqe->user_data];
+        slot->result = cqe->res;
+        slot->reaped = 1;
+        writer->in_ring--;
+        __atomic_store_n(q->cq_head, ++head, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+Wait for a write to come back, or briefly when none is in the ring, and collect what finished
+*/
+static void wait_for_completion(frameWriter *writer) {
+    if (writer->in_ring > 0) {
+        syscall(__NR_io_uring_enter, writer->ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);     // EINTR just returns early
+    } else {
+        usleep(1000);
+    }
+    collect_completions(writer);
+}
+
+/*
+Stop writing slot's file with O_DIRECT, for its tail or because the filesystem refused it
+*/
+static void drop_direct(writeSlot *slot) {
+    int flags = fcntl(slot->fd, F_GETFL);
+    if (flags >= 0) {
+        fcntl(slot->fd, F_SETFL, flags & ~O_DIRECT);                    // No I/O, just the file's flags
+    }
+    slot->direct = 0;
+}
+
+/*
+Point slot's iov at the rest of the frame. With O_DIRECT that is only its whole blocks, and the
+tail under a block is written through the page cache.
+*/
+static void next_write(writeSlot *slot) {
+    if (slot->direct && slot->size - slot->done < DIRECT_ALIGN) {
+        drop_direct(slot);
+    }
+    size_t left = slot->size - slot->done;
+    slot->iov.iov_base = slot->data + slot->done;
+    slot->iov.iov_len = slot->direct ? left / DIRECT_ALIGN * DIRECT_ALIGN : left;
+}
+
+/*
+Count a write of slot's file that returned n (or -1 with errno set) toward the frame. Returns
+an errno value if the write failed for good, 0 otherwise.
+*/
+static int wrote(writeSlot *slot, ssize_t n, int error) {
+    if (n < 0 && error == EINVAL && slot->direct) {
+        drop_direct(slot);                                              // Refused O_DIRECT after opening with it
+        return 0;
+    }
+    if (n < 0) {
+        return error == EINTR ? 0 : error;
+    }
+    if (n == 0) {
+        return EIO;
+    }
+    slot->done += n;
+    if (slot->direct) {
+        slot->done -= slot->done % DIRECT_ALIGN;                        // Rewrite a short block, O_DIRECT offsets stay aligned
+    }
+    return 0;
+}
+
+/*
+Queue slot s's request for its stage. Returns 0 on success, an errno value on failure, in
+which case the kernel never saw the entry and the slot is free to finish.
+*/
+static int submit_slot(frameWriter *writer, int s) {
+    uringQueue *q = &writer->ring;
+    writeSlot *slot = &writer->slots[s];
+
+    unsigned tail = *q->sq_tail;                                        // Only this thread moves the tail
+    unsigned i = tail & *q->sq_mask;
+    struct io_uring_sqe *sqe = &q->sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    if (slot->stage == STAGE_OPEN) {
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)slot->path;
+        sqe->len = 0644;                                                // The mode
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | (slot->direct ? O_DIRECT : 0);
+    } else if (slot->stage == STAGE_WRITE) {
+        next_write(slot);
+        sqe->opcode = IORING_OP_WRITEV;                                 // In every io_uring kernel, unlike IORING_OP_WRITE
+        sqe->fd = slot->fd;
+        sqe->addr = (unsigned long)&slot->iov;
+        sqe->len = 1;
+        sqe->off = slot->done;
+    } else {
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = slot->fd;
+    }
+    sqe->user_data = s;
+    q->sq_array[i] = i;
+    __atomic_store_n(q->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    for (int attempt = 0;; ++attempt) {
+        long submitted = syscall(__NR_io_uring_enter, q->fd, 1, 0, 0, NULL, 0);
+        int error = submitted < 0 ? errno : EAGAIN;                     // Nothing taken, try again
+        if (submitted == 1 || __atomic_load_n(q->sq_head, __ATOMIC_ACQUIRE) != tail) {
+            writer->in_ring++;                                          // Taken, its result comes back as a completion
+            return 0;
+        }
+        if (error == EINTR) {
+            continue;
+        }
+        if ((error == EAGAIN || error == EBUSY) && attempt < ENTER_RETRIES) {
+            wait_for_completion(writer);                                // Out of requests, or the completions need room
+            continue;
+        }
+        __atomic_store_n(q->sq_tail, tail, __ATOMIC_RELEASE);           // Take the entry back before the slot is reused
+        return error;
+    }
+}
+
+/*
+Hand slot s's file to the callback, then free the slot
+*/
+static void finish_slot(frameWriter *writer, int s) {
+    writeSlot *slot = &writer->slots[s];
+    writer->written(writer->context, slot->index, slot->path, slot->data, slot->size, slot->note,
+                    monotonicNs() - slot->start_ns, slot->error);
+    free(slot->data);
+    slot->data = NULL;
+}
+
+/*
+Move io_uring slot s on to its next request after the last one came back. Returns 1 while the
+slot has a request in the ring, 0 once its file is finished.
+*/
+static int advance_slot(frameWriter *writer, int s) {
+    writeSlot *slot = &writer->slots[s];
+    int result = slot->result;
+    if (slot->stage == STAGE_OPEN) {
+        if (result == -EINVAL && slot->direct) {
+            slot->direct = 0;                                           // tmpfs and some network filesystems refuse O_DIRECT
+        } else if (result < 0) {
+            slot->error = -result;
+            return 0;                                                   // Nothing to close
+        } else {
+            slot->fd = result;
+            slot->stage = slot->size > 0 ? STAGE_WRITE : STAGE_CLOSE;
+        }
+    } else if (slot->stage == STAGE_WRITE) {
+        slot->error = wrote(slot, result < 0 ? -1 : result, -result);
+        if (slot->error || slot->done == slot->size) {
+            slot->stage = STAGE_CLOSE;                                  // Otherwise a short write, queue the rest
+        }
+    } else {
+        if (result < 0 && !slot->error) {
+            slot->error = -result;                                      // Network filesystems report write errors here
+        }
+        return 0;
+    }
+
+    int error = submit_slot(writer, s);
+    if (error) {
+        if (slot->fd >= 0) {
+            close(slot->fd);                                            // The ring is failing, close it here
+        }
+        slot->error = slot->error ? slot->error : error;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+Finish the io_uring files that are done and queue the next request of the rest, waiting for at
+least one request to come back first if wait is set
+*/
+static void reap_uring(frameWriter *writer, int wait) {
+    collect_completions(writer);
+    int reaped = 0;
+    for (int s = 0; s < writer->depth; ++s) {
+        reaped |= writer->slots[s].reaped;
+    }
+    if (wait && !reaped && writer->in_ring > 0) {
+        while (syscall(__NR_io_uring_enter, writer->ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+               errno == EINTR) {
+        }
+        collect_completions(writer);
+    }
+
+    for (int s = 0; s < writer->depth; ++s) {
+        writeSlot *slot = &writer->slots[s];
+        if (!slot->reaped) {
+            continue;
+        }
+        slot->reaped = 0;
+        if (advance_slot(writer, s)) {
+            continue;
+        }
+        finish_slot(writer, s);
+        slot->busy = 0;
+        writer->in_flight--;
+    }
+}
+
+/*
+Create path for writing, with O_DIRECT if asked for and the filesystem takes it. Sets *direct to whether it did.
+*/
+static int open_frame(const char *path, int *direct) {
+    if (*direct) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (fd >= 0 || errno != EINVAL) {
+            return fd;
+        }
+        *direct = 0;                                                    // tmpfs and some network filesystems refuse it
+    }
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+/*
+The thread backend: open, write and close the queued files in order until told to stop
+*/
+static void *writer_thread(void *arg) {
+    frameWriter *writer = arg;
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->count == 0 && !writer->shutdown) {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+        if (writer->count == 0) {
+            break;                                                      // Shut down with nothing left to write
+        }
+        int s = writer->order[writer->head];
+        writer->head = (writer->head + 1) % writer->depth;
+        writer->count--;
+        pthread_mutex_unlock(&writer->lock);
+
+        writeSlot *slot = &writer->slots[s];
+        if (!slot->error && (slot->fd = open_frame(slot->path, &slot->direct)) < 0) {
+            slot->error = errno;
+        }
+        while (slot->fd >= 0 && slot->done < slot->size && !slot->error) {
+            next_write(slot);
+            ssize_t n = pwrite(slot->fd, slot->iov.iov_base, slot->iov.iov_len, slot->done);
+            slot->error = wrote(slot, n, errno);
+        }
+        if (slot->fd >= 0 && close(slot->fd) != 0 && !slot->error) {
+            slot->error = errno;                                        // Network filesystems report write errors here
+        }
+        finish_slot(writer, s);
+
+        pthread_mutex_lock(&writer->lock);
+        slot->busy = 0;
+        writer->in_flight--;
+        pthread_cond_broadcast(&writer->changed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+frameWriter *initFrameWriter(int depth, int direct, frameWrittenFn written, void *context) {
+    if (depth < 1) {
+        depth = 1;
+    }
+    frameWriter *writer = calloc(1, sizeof(frameWriter));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->depth = depth;
+    writer->direct = direct;
+    writer->written = written;
+    writer->context = context;
+    writer->slots = calloc(depth, sizeof(writeSlot));
+    writer->order = calloc(depth, sizeof(int));
+    if (writer->slots == NULL || writer->order == NULL) {
+        free(writer->order);
+        free(writer->slots);
+        free(writer);
+        return NULL;
+    }
+
+    writer->uring = init_uring(&writer->ring, depth) == 0;
+    if (writer->uring && !uring_has_ops(&writer->ring)) {
+        free_uring(&writer->ring);                                      // Opening on the encoder thread would stall it
+        writer->uring = 0;
+    }
+    if (!writer->uring) {
+        pthread_mutex_init(&writer->lock, NULL);
+        pthread_cond_init(&writer->changed, NULL);
+        if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0) {
+            pthread_cond_destroy(&writer->changed);
+            pthread_mutex_destroy(&writer->lock);
+            free(writer->order);
+            free(writer->slots);
+            free(writer);
+            return NULL;
+        }
+    }
+    return writer;
+}
+
+const char *frameWriterBackend(const frameWriter *writer) {
+    return writer->uring ? "io_uring" : "thread";
+}
+
+int queueFrameWrite(frameWriter *writer, const char *path, int index, unsigned char *data, size_t size,
+                    const char *note) {
+    if (writer->direct) {
+        unsigned char *aligned;
+        if (posix_memalign((void **)&aligned, DIRECT_ALIGN, size > 0 ? size : DIRECT_ALIGN) != 0) {
+            free(data);
+            return -1;
+        }
+        memcpy(aligned, data, size);
+        free(data);
+        data = aligned;
+    }
+
+    if (writer->uring) {
+        while (writer->in_flight == writer->depth) {
+            reap_uring(writer, 1);                                      // Every slot busy, wait for a file to finish
+        }
+    } else {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->in_flight == writer->depth) {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+    }
+    int s = 0;
+    while (writer->slots[s].busy) {
+        s++;
+    }
+    writeSlot *slot = &writer->slots[s];
+    *slot = (writeSlot){
+        .busy = 1,
+        .fd = -1,
+        .index = index,
+        .data = data,
+        .size = size,
+        .direct = writer->direct,
+        .stage = STAGE_OPEN,
+        .start_ns = monotonicNs(),
+    };
+    if (snprintf(slot->path, sizeof(slot->path), "%s", path) >= sizeof(slot->path)) {
+        slot->error = ENAMETOOLONG;
+    }
+    snprintf(slot->note, sizeof(slot->note), "%s", note);
+    writer->in_flight++;
+
+    if (!writer->uring) {
+        writer->order[(writer->head + writer->count) % writer->depth] = s;
+        writer->count++;
+        pthread_cond_broadcast(&writer->changed);
+        pthread_mutex_unlock(&writer->lock);
+        return 0;
+    }
+    int error = slot->error ? slot->error : submit_slot(writer, s);
+    if (error) {
+        slot->error = error;
+        finish_slot(writer, s);                                         // Nothing in the ring for this one
+        slot->busy = 0;
+        writer->in_flight--;
+        return 0;
+    }
+    reap_uring(writer, 0);                                              // Report what has finished meanwhile
+    return 0;
+}
+
+void freeFrameWriter(frameWriter *writer) {
+    if (writer->uring) {
+        while (writer->in_flight > 0) {
+            reap_uring(writer, 1);
+        }
+        free_uring(&writer->ring);
+    } else {
+        pthread_mutex_lock(&writer->lock);
+        writer->shutdown = 1;
+        pthread_cond_broadcast(&writer->changed);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, NULL);
+        pthread_cond_destroy(&writer->changed);
+        pthread_mutex_destroy(&writer->lock);
+    }
+    free(writer->order);
+    free(writer->slots);
+    free(writer);
+}
@@ -0,0 +1,38 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <stddef.h>
+
+// Writes encoded frames to their files in the background, so a slow disk
+// or network filesystem doesn't hold up the encoder and, behind it, the
+// next frames' computation. Up to depth files are written at once. The
+// opens, writes and closes go through io_uring where the kernel has it,
+// set up with plain system calls, and through a writer thread otherwise.
+typedef struct frameWriter frameWriter;
+
+// Called once a frame's file is complete and closed, or failed with error
+// (an errno value, 0 on success). With io_uring it runs on the thread
+// calling queueFrameWrite() or freeFrameWriter(), with the writer thread
+// on that thread. data is freed after it returns.
+typedef void (*frameWrittenFn)(void* context, int index, const char* path, const unsigned char* data, size_t size,
+							   const char* note, long long write_ns, int error);
+
+// direct writes the whole blocks of the files with O_DIRECT where the
+// filesystem allows it, so the frames bypass the page cache. Returns NULL
+// on failure.
+frameWriter* initFrameWriter(int depth, int direct, frameWrittenFn written, void* context);
+
+// "io_uring" or "thread"
+const char* frameWriterBackend(const frameWriter* writer);
+
+// Create path and write size bytes of data, allocated with malloc and now
+// owned by the writer, to it. Only waits when depth files are already under
+// way. Failing to create the file is reported to the callback like a failed
+// write. Returns 0 on success, -1 if the frame could not be queued.
+int queueFrameWrite(frameWriter* writer, const char* path, int index, unsigned char* data, size_t size,
+					const char* note);
+
+// Wait for every queued write to finish, then free the writer
+void freeFrameWriter(frameWriter* writer);
+
+#endif  /* Compile guard */
@@ -0,0 +1,393 @@
+/**************************************************************
+Filename: gpukernel.c
+Description: The GPU backend of the iteration kernel. OpenCL is
+opened with dlopen() and the handful of entry points it uses are
+declared here, so neither the headers nor the library are needed
+to build, and a machine without a GPU just reports that it has
+none. Each frame is one 2D launch over its pixels. The device
+program is iterations_early_out() (or iterations_at_point() with
+the early-outs off) in double precision with contraction off, so
+its counts are those of the CPU kernels. A frame's coordinates go
+in, and its counts come back, through buffers of its own slot,
+and everything is queued without waiting, so the device works on
+one frame while the CPU finishes the one before.
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "gpukernel.h"
+
+// The OpenCL 1.2 types and constants used here, from the Khronos headers
+typedef int32_t cl_int;
+typedef uint32_t cl_uint;
+typedef uint64_t cl_ulong;
+typedef cl_ulong cl_bitfield;
+typedef struct _cl_platform_id *cl_platform_id;
+typedef struct _cl_device_id *cl_device_id;
+typedef struct _cl_context *cl_context;
+typedef struct _cl_command_queue *cl_command_queue;
+typedef struct _cl_program *cl_program;
+typedef struct _cl_kernel *cl_kernel;
+typedef struct _cl_mem *cl_mem;
+typedef struct _cl_event *cl_event;
+
+#define CL_SUCCESS                  0
+#define CL_FALSE                    0
+#define CL_DEVICE_TYPE_GPU          (1 << 2)
+#define CL_DEVICE_NAME              0x102B
+#define CL_DEVICE_DOUBLE_FP_CONFIG  0x1032
+#define CL_PROGRAM_BUILD_LOG        0x1183
+#define CL_MEM_WRITE_ONLY           (1 << 1)
+#define CL_MEM_READ_ONLY            (1 << 2)
+
+#define GPU_MAX_DEVICES 64
+#define GPU_FIRST_SNAPSHOT 8            // FIRST_SNAPSHOT of kernel.c
+
+// The device side: one work item per pixel, the loops of kernel.c
+static const char *program_source =
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "#pragma OPENCL FP_CONTRACT OFF\n"
+    "__kernel void iterate(__global const double *cx, __global const double *cy, __global int *counts, int max) {\n"
+    "    int i = get_global_id(0);\n"
+    "    int j = get_global_id(1);\n"
+    "    double x0 = cx[i];\n"
+    "    double y0 = cy[j];\n"
+    "    double x = x0;\n"
+    "    double y = y0;\n"
+    "    int iter = 0;\n"
+    "#if EARLY_OUT\n"
+    "    double xq = x - 0.25;\n"
+    "    double q = xq * xq + y * y;\n"
+    "    if (q * (q + xq) <= 0.25 * y * y || (x + 1) * (x + 1) + y * y <= 0.0625) {\n"
+    "        counts[j * get_global_size(0) + i] = max;\n"
+    "        return;\n"
+    "    }\n"
+    "    double sx = x;\n"
+    "    double sy = y;\n"
+    "    int snapshot = FIRST_SNAPSHOT;\n"
+    "#endif\n"
+    "    while ((x * x + y * y <= 4) && iter < max) {\n"
+    "        double xt = x * x - y * y + x0;\n"
+    "        double yt = 2 * x * y + y0;\n"
+    "        x = xt;\n"
+    "        y = yt;\n"
+    "        iter++;\n"
+    "#if EARLY_OUT\n"
+    "        if (x == sx && y == sy) {\n"
+    "            iter = max;\n"
+    "            break;\n"
+    "        }\n"
+    "        if (iter == snapshot) {\n"
+    "            sx = x;\n"
+    "            sy = y;\n"
+    "            snapshot <<= 1;\n"
+    "        }\n"
+    "#endif\n"
+    "    }\n"
+    "    counts[j * get_global_size(0) + i] = iter;\n"
+    "}\n";
+
+// The entry points, looked up by name
+typedef struct openCL {
+    void *library;
+    cl_int (*GetPlatformIDs)(cl_uint, cl_platform_id *, cl_uint *);
+    cl_int (*GetDeviceIDs)(cl_platform_id, cl_bitfield, cl_uint, cl_device_id *, cl_uint *);
+    cl_int (*GetDeviceInfo)(cl_device_id, cl_uint, size_t, void *, size_t *);
+    cl_context (*CreateContext)(const intptr_t *, cl_uint, const cl_device_id *, void *, void *, cl_int *);
+    cl_command_queue (*CreateCommandQueue)(cl_context, cl_device_id, cl_bitfield, cl_int *);
+    cl_program (*CreateProgramWithSource)(cl_context, cl_uint, const char **, const size_t *, cl_int *);
+    cl_int (*BuildProgram)(cl_program, cl_uint, const cl_device_id *, const char *, void *, void *);
+    cl_int (*GetProgramBuildInfo)(cl_program, cl_device_id, cl_uint, size_t, void *, size_t *);
+    cl_kernel (*CreateKernel)(cl_program, const char *, cl_int *);
+    cl_mem (*CreateBuffer)(cl_context, cl_bitfield, size_t, void *, cl_int *);
+    cl_int (*SetKernelArg)(cl_kernel, cl_uint, size_t, const void *);
+    cl_int (*EnqueueWriteBuffer)(cl_command_queue, cl_mem, cl_uint, size_t, size_t, const void *,
+                                 cl_uint, const cl_event *, cl_event *);
+    cl_int (*EnqueueReadBuffer)(cl_command_queue, cl_mem, cl_uint, size_t, size_t, void *,
+                                cl_uint, const cl_event *, cl_event *);
+    cl_int (*EnqueueNDRangeKernel)(cl_command_queue, cl_kernel, cl_uint, const size_t *, const size_t *,
+                                   const size_t *, cl_uint, const cl_event *, cl_event *);
+    cl_int (*Flush)(cl_command_queue);
+    cl_int (*Finish)(cl_command_queue);
+    cl_int (*WaitForEvents)(cl_uint, const cl_event *);
+    cl_int (*ReleaseEvent)(cl_event);
+    cl_int (*ReleaseMemObject)(cl_mem);
+    cl_int (*ReleaseKernel)(cl_kernel);
+    cl_int (*ReleaseProgram)(cl_program);
+    cl_int (*ReleaseCommandQueue)(cl_command_queue);
+    cl_int (*ReleaseContext)(cl_context);
+} openCL;
+
+// The buffers of one frame in flight
+typedef struct gpuSlot {
+    double *cx;                         // Host copies of the coordinates, read by the queued writes
+    double *cy;
+    cl_mem cx_mem;
+    cl_mem cy_mem;
+    cl_mem counts_mem;
+    int *counts;                        // Where the counts are read back to
+    cl_event done;                      // The read of the counts, NULL when the slot is free
+} gpuSlot;
+
+struct gpuRenderer {
+    openCL cl;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel kernel;
+    int width;
+    int height;
+    int next_slot;
+    gpuSlot slots[GPU_FRAMES_IN_FLIGHT];
+    char name[128];
+};
+
+/*
+Open the OpenCL library and look up every entry point. Returns 0 on success.
+*/
+static int load_opencl(openCL *cl, char *error, size_t errorSize) {
+    const char *names[] = { "libOpenCL.so.1", "libOpenCL.so", "/System/Library/Frameworks/OpenCL.framework/OpenCL" };
+    for (int k = 0; k < 3 && cl->library == NULL; ++k) {
+        cl->library = dlopen(names[k], RTLD_NOW | RTLD_LOCAL);
+    }
+    if (cl->library == NULL) {
+        snprintf(error, errorSize, "no OpenCL library");
+        return -1;
+    }
+
+#define LOAD(fn)                                                                \
+    if ((*(void **)&cl->fn = dlsym(cl->library, "cl" #fn)) == NULL) {          \
+        snprintf(error, errorSize, "OpenCL has no cl%s", #fn);                  \
+        return -1;                                                              \
+    }
+    LOAD(GetPlatformIDs);
+    LOAD(GetDeviceIDs);
+    LOAD(GetDeviceInfo);
+    LOAD(CreateContext);
+    LOAD(CreateCommandQueue);
+    LOAD(CreateProgramWithSource);
+    LOAD(BuildProgram);
+    LOAD(GetProgramBuildInfo);
+    LOAD(CreateKernel);
+    LOAD(CreateBuffer);
+    LOAD(SetKernelArg);
+    LOAD(EnqueueWriteBuffer);
+    LOAD(EnqueueReadBuffer);
+    LOAD(EnqueueNDRangeKernel);
+    LOAD(Flush);
+    LOAD(Finish);
+    LOAD(WaitForEvents);
+    LOAD(ReleaseEvent);
+    LOAD(ReleaseMemObject);
+    LOAD(ReleaseKernel);
+    LOAD(ReleaseProgram);
+    LOAD(ReleaseCommandQueue);
+    LOAD(ReleaseContext);
+#undef LOAD
+    return 0;
+}
+
+/*
+The device'th GPU over all platforms, wrapping around. Returns NULL if there are none.
+*/
+static cl_device_id find_device(const openCL *cl, int device) {
+    cl_platform_id platforms[16];
+    cl_uint num_platforms = 0;
+    if (cl->GetPlatformIDs(16, platforms, &num_platforms) != CL_SUCCESS) {
+        return NULL;                                                        // No platforms is an error to the ICD loader
+    }
+    cl_device_id devices[GPU_MAX_DEVICES];
+    int num_devices = 0;
+    for (cl_uint p = 0; p < num_platforms && p < 16; ++p) {
+        cl_uint n = 0;
+        if (cl->GetDeviceIDs(platforms[p], CL_DEVICE_TYPE_GPU, GPU_MAX_DEVICES - num_devices,
+                             devices + num_devices, &n) == CL_SUCCESS) {
+            num_devices += n < GPU_MAX_DEVICES - num_devices ? n : GPU_MAX_DEVICES - num_devices;
+        }
+    }
+    return num_devices > 0 ? devices[device % num_devices] : NULL;
+}
+
+/*
+Compile the device program, with the build log as the error when it fails. Returns 0 on success.
+*/
+static int build_program(gpuRenderer *gpu, cl_device_id device, int earlyOut, char *error, size_t errorSize) {
+    cl_int status;
+    gpu->program = gpu->cl.CreateProgramWithSource(gpu->context, 1, &program_source, NULL, &status);
+    if (status != CL_SUCCESS) {
+        snprintf(error, errorSize, "could not create the program (%d)", status);
+        return -1;
+    }
+    char options[64];
+    snprintf(options, sizeof(options), "-DEARLY_OUT=%d -DFIRST_SNAPSHOT=%d", earlyOut != 0, GPU_FIRST_SNAPSHOT);
+    if (gpu->cl.BuildProgram(gpu->program, 1, &device, options, NULL, NULL) != CL_SUCCESS) {
+        char log[512] = "";
+        gpu->cl.GetProgramBuildInfo(gpu->program, device, CL_PROGRAM_BUILD_LOG, sizeof(log) - 1, log, NULL);
+        snprintf(error, errorSize, "the program does not build: %s", log);
+        return -1;
+    }
+    gpu->kernel = gpu->cl.CreateKernel(gpu->program, "iterate", &status);
+    if (status != CL_SUCCESS) {
+        snprintf(error, errorSize, "could not create the kernel (%d)", status);
+        return -1;
+    }
+    return 0;
+}
+
+gpuRenderer *initGpuRenderer(int device, int width, int height, int earlyOut, char *error, size_t errorSize) {
+    gpuRenderer *gpu = calloc(1, sizeof(gpuRenderer));
+    if (gpu == NULL) {
+        snprintf(error, errorSize, "out of memory");
+        return NULL;
+    }
+    gpu->width = width;
+    gpu->height = height;
+    if (load_opencl(&gpu->cl, error, errorSize) != 0) {
+        freeGpuRenderer(gpu);
+        return NULL;
+    }
+
+    cl_device_id id = find_device(&gpu->cl, device);
+    if (id == NULL) {
+        snprintf(error, errorSize, "no OpenCL GPU");
+        freeGpuRenderer(gpu);
+        return NULL;
+    }
+    gpu->cl.GetDeviceInfo(id, CL_DEVICE_NAME, sizeof(gpu->name) - 1, gpu->name, NULL);
+    cl_ulong fp64 = 0;
+    if (gpu->cl.GetDeviceInfo(id, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp64), &fp64, NULL) != CL_SUCCESS || fp64 == 0) {
+        snprintf(error, errorSize, "%s has no double precision", gpu->name);
+        freeGpuRenderer(gpu);
+        return NULL;
+    }
+
+    cl_int status;
+    gpu->context = gpu->cl.CreateContext(NULL, 1, &id, NULL, NULL, &status);
+    if (status == CL_SUCCESS) {
+        gpu->queue = gpu->cl.CreateCommandQueue(gpu->context, id, 0, &status);  // In order, so a slot's write, launch and read run in turn
+    }
+    if (status != CL_SUCCESS) {
+        snprintf(error, errorSize, "could not open %s (%d)", gpu->name, status);
+        freeGpuRenderer(gpu);
+        return NULL;
+    }
+    if (build_program(gpu, id, earlyOut, error, errorSize) != 0) {
+        freeGpuRenderer(gpu);
+        return NULL;
+    }
+
+    for (int s = 0; s < GPU_FRAMES_IN_FLIGHT; ++s) {
+        gpuSlot *slot = &gpu->slots[s];
+        slot->cx = malloc(sizeof(double) * width);
+        slot->cy = malloc(sizeof(double) * height);
+        slot->counts = malloc(sizeof(int) * width * height);
+        slot->cx_mem = gpu->cl.CreateBuffer(gpu->context, CL_MEM_READ_ONLY, sizeof(double) * width, NULL, &status);
+        cl_int status_y, status_counts;
+        slot->cy_mem = gpu->cl.CreateBuffer(gpu->context, CL_MEM_READ_ONLY, sizeof(double) * height, NULL, &status_y);
+        slot->counts_mem = gpu->cl.CreateBuffer(gpu->context, CL_MEM_WRITE_ONLY, sizeof(int) * width * height, NULL,
+                                                &status_counts);
+        if (slot->cx == NULL || slot->cy == NULL || slot->counts == NULL ||
+            status != CL_SUCCESS || status_y != CL_SUCCESS || status_counts != CL_SUCCESS) {
+            snprintf(error, errorSize, "could not allocate frame buffers on %s", gpu->name);
+            freeGpuRenderer(gpu);
+            return NULL;
+        }
+    }
+    return gpu;
+}
+
+void freeGpuRenderer(gpuRenderer *gpu) {
+    if (gpu->queue != NULL) {
+        gpu->cl.Finish(gpu->queue);                                         // Nothing may still use the buffers
+    }
+    for (int s = 0; s < GPU_FRAMES_IN_FLIGHT; ++s) {
+        gpuSlot *slot = &gpu->slots[s];
+        if (slot->done != NULL) {
+            gpu->cl.ReleaseEvent(slot->done);
+        }
+        if (slot->counts_mem != NULL) {
+            gpu->cl.ReleaseMemObject(slot->counts_mem);
+        }
+        if (slot->cy_mem != NULL) {
+            gpu->cl.ReleaseMemObject(slot->cy_mem);
+        }
+        if (slot->cx_mem != NULL) {
+            gpu->cl.ReleaseMemObject(slot->cx_mem);
+        }
+        free(slot->counts);
+        free(slot->cy);
+        free(slot->cx);
+    }
+    if (gpu->kernel != NULL) {
+        gpu->cl.ReleaseKernel(gpu->kernel);
+    }
+    if (gpu->program != NULL) {
+        gpu->cl.ReleaseProgram(gpu->program);
+    }
+    if (gpu->queue != NULL) {
+        gpu->cl.ReleaseCommandQueue(gpu->queue);
+    }
+    if (gpu->context != NULL) {
+        gpu->cl.ReleaseContext(gpu->context);
+    }
+    if (gpu->cl.library != NULL) {
+        dlclose(gpu->cl.library);
+    }
+    free(gpu);
+}
+
+const char *gpuDeviceName(const gpuRenderer *gpu) {
+    return gpu->name;
+}
+
+int submitGpuFrame(gpuRenderer *gpu, const double *cx, const double *cy, int max) {
+    int s = gpu->next_slot;
+    gpuSlot *slot = &gpu->slots[s];
+    if (slot->done != NULL) {
+        return -1;                                                          // Every slot is still waiting to be collected
+    }
+    memcpy(slot->cx, cx, sizeof(double) * gpu->width);
+    memcpy(slot->cy, cy, sizeof(double) * gpu->height);
+
+    size_t global[2] = { gpu->width, gpu->height };
+    cl_int status = gpu->cl.EnqueueWriteBuffer(gpu->queue, slot->cx_mem, CL_FALSE, 0, sizeof(double) * gpu->width,
+                                               slot->cx, 0, NULL, NULL);
+    status |= gpu->cl.EnqueueWriteBuffer(gpu->queue, slot->cy_mem, CL_FALSE, 0, sizeof(double) * gpu->height,
+                                         slot->cy, 0, NULL, NULL);
+    status |= gpu->cl.SetKernelArg(gpu->kernel, 0, sizeof(cl_mem), &slot->cx_mem);    // Taken as they are at the launch
+    status |= gpu->cl.SetKernelArg(gpu->kernel, 1, sizeof(cl_mem), &slot->cy_mem);
+    status |= gpu->cl.SetKernelArg(gpu->kernel, 2, sizeof(cl_mem), &slot->counts_mem);
+    status |= gpu->cl.SetKernelArg(gpu->kernel, 3, sizeof(cl_int), &max);
+    status |= gpu->cl.EnqueueNDRangeKernel(gpu->queue, gpu->kernel, 2, NULL, global, NULL, 0, NULL, NULL);
+    status |= gpu->cl.EnqueueReadBuffer(gpu->queue, slot->counts_mem, CL_FALSE, 0, sizeof(int) * gpu->width * gpu->height,
+                                        slot->counts, 0, NULL, &slot->done);
+    if (status != CL_SUCCESS) {
+        gpu->cl.Finish(gpu->queue);                                         // Don't leave a half queued frame behind
+        if (slot->done != NULL) {
+            gpu->cl.ReleaseEvent(slot->done);
+            slot->done = NULL;
+        }
+        return -1;
+    }
+    gpu->cl.Flush(gpu->queue);                                              // Start it now, not at the next wait
+    gpu->next_slot = (s + 1) % GPU_FRAMES_IN_FLIGHT;
+    return s;
+}
+
+int finishGpuFrame(gpuRenderer *gpu, int s, int *counts) {
+    gpuSlot *slot = &gpu->slots[s];
+    if (slot->done == NULL) {
+        return -1;
+    }
+    cl_int status = gpu->cl.WaitForEvents(1, &slot->done);
+    gpu->cl.ReleaseEvent(slot->done);
+    slot->done = NULL;
+    if (status != CL_SUCCESS) {
+        return -1;
+    }
+    memcpy(counts, slot->counts, sizeof(int) * gpu->width * gpu->height);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef GPUKERNEL_H
+#define GPUKERNEL_H
+
+// The iteration kernel on a GPU, through OpenCL. The OpenCL library is
+// loaded when a renderer is started, so the programs build and run on
+// machines without one. A renderer iterates whole frames in double
+// precision with the same operations as the CPU kernels, so its counts
+// match theirs exactly. Frames are queued on the device and their counts
+// fetched later, so up to GPU_FRAMES_IN_FLIGHT frames can be in the
+// works while the CPU colors and encodes the ones before them.
+#define GPU_FRAMES_IN_FLIGHT 2
+
+typedef struct gpuRenderer gpuRenderer;
+
+// Start a renderer for width by height frames on GPU number device,
+// counting every GPU of every OpenCL platform, wrapping around past the
+// last one. earlyOut matches setEarlyOut(). Returns NULL on failure, with
+// the reason in error.
+gpuRenderer* initGpuRenderer(int device, int width, int height, int earlyOut, char* error, size_t errorSize);
+
+void freeGpuRenderer(gpuRenderer* gpu);
+
+const char* gpuDeviceName(const gpuRenderer* gpu);
+
+// Queue a frame with pixel (i,j) at (cx[i],cy[j]) - the arrays are copied
+// before this returns. Returns the slot to collect its counts from, or -1
+// on failure. At most GPU_FRAMES_IN_FLIGHT frames may be waiting.
+int submitGpuFrame(gpuRenderer* gpu, const double* cx, const double* cy, int max);
+
+// Wait for the frame in slot and copy its counts, laid out like
+// compute_counts, into counts. Returns 0 on success.
+int finishGpuFrame(gpuRenderer* gpu, int slot, int* counts);
+
+#endif  /* Compile guard */
@@ -0,0 +1,251 @@
+/**************************************************************
+Filename: iterfile.c
+Description: Saves the iteration counts of a frame next to its
+image, and maps them back in. The colors only depend on the
+counts and the palette, so a saved frame can be recolored
+without iterating it again. Neighbouring counts are mostly
+equal, so the optional compression codes every count as the
+difference from its left neighbour and deflates blocks of rows,
+which keeps the blocks independent for reading only some rows.
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "iterfile.h"
+
+struct iterFile {
+    const unsigned char *map;           // The whole file
+    size_t size;
+    const iterFileHeader *header;       // Start of the map
+    const uint64_t *offsets;            // Compressed only: num_blocks+1 block offsets
+};
+
+static int num_blocks(const iterFileHeader *header) {
+    return (header->height + header->block_rows - 1) / header->block_rows;
+}
+
+// Store width counts as bpc byte values, delta coded if asked to
+static void pack_row(unsigned char *out, const int *row, int width, int bpc, int delta) {
+    uint32_t prev = 0;
+    for (int i = 0; i < width; ++i) {
+        uint32_t v = (uint32_t)row[i];
+        uint32_t d = delta ? v - prev : v;
+        prev = v;
+        if (bpc == 2) {
+            uint16_t d16 = (uint16_t)d;
+            memcpy(out + 2 * i, &d16, 2);
+        } else {
+            memcpy(out + 4 * i, &d, 4);
+        }
+    }
+}
+
+// The inverse of pack_row, clamping damaged counts to max
+static void unpack_row(int *row, const unsigned char *in, int width, int bpc, int delta, int max) {
+    uint32_t prev = 0;
+    for (int i = 0; i < width; ++i) {
+        uint32_t d;
+        if (bpc == 2) {
+            uint16_t d16;
+            memcpy(&d16, in + 2 * i, 2);
+            d = d16;
+        } else {
+            memcpy(&d, in + 4 * i, 4);
+        }
+        uint32_t v = delta ? prev + d : d;
+        if (bpc == 2) {
+            v &= 0xFFFF;
+        }
+        prev = v;
+        row[i] = v > (uint32_t)max ? max : (int)v;
+    }
+}
+
+int storeIterFile(const char *fname, const int *counts, const iterFrameInfo *info, iterCompression compression) {
+    iterFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ITERFILE_MAGIC, sizeof(header.magic));
+    header.version = ITERFILE_VERSION;
+    header.width = info->width;
+    header.height = info->height;
+    header.max = info->max;
+    header.bytes_per_count = info->max <= UINT16_MAX ? 2 : 4;
+    header.compression = compression;
+    header.block_rows = ITERFILE_BLOCK_ROWS;
+    header.xcenter = info->xcenter;
+    header.ycenter = info->ycenter;
+    header.xscale = info->xscale;
+    header.yscale = info->yscale;
+
+    int width = header.width;
+    int bpc = header.bytes_per_count;
+    int delta = compression == ITER_DELTA_ZLIB;
+    int rows_per_pack = delta ? header.block_rows : 1;          // A block at a time, or a row at a time
+    size_t pack_bytes = (size_t)rows_per_pack * width * bpc;
+
+    FILE *file = fopen(fname, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+
+    unsigned char *packed = malloc(pack_bytes);
+    uLongf bound = compressBound(pack_bytes);
+    unsigned char *deflated = delta ? malloc(bound) : NULL;
+    int blocks = num_blocks(&header);
+    uint64_t *offsets = delta ? malloc(sizeof(uint64_t) * (blocks + 1)) : NULL;
+    failed |= packed == NULL || (delta && (deflated == NULL || offsets == NULL));
+
+    if (delta && !failed) {
+        offsets[0] = sizeof(header) + sizeof(uint64_t) * (blocks + 1);
+        failed |= fseek(file, offsets[0], SEEK_SET) != 0;                   // The offsets are filled in at the end
+    }
+    for (int j0 = 0, b = 0; j0 < header.height && !failed; j0 += rows_per_pack, ++b) {
+        int rows = j0 + rows_per_pack < header.height ? rows_per_pack : header.height - j0;
+        for (int j = 0; j < rows; ++j) {
+            pack_row(packed + (size_t)j * width * bpc, counts + (size_t)(j0 + j) * width, width, bpc, delta);
+        }
+        size_t bytes = (size_t)rows * width * bpc;
+        if (delta) {
+            uLongf deflated_bytes = bound;
+            failed |= compress2(deflated, &deflated_bytes, packed, bytes, Z_BEST_SPEED) != Z_OK;
+            failed |= !failed && fwrite(deflated, 1, deflated_bytes, file) != deflated_bytes;
+            offsets[b + 1] = offsets[b] + deflated_bytes;
+        } else {
+            failed |= fwrite(packed, 1, bytes, file) != bytes;
+        }
+    }
+    if (delta && !failed) {
+        failed |= fseek(file, sizeof(header), SEEK_SET) != 0;
+        failed |= !failed && fwrite(offsets, sizeof(uint64_t), blocks + 1, file) != (size_t)blocks + 1;
+    }
+
+    free(offsets);
+    free(deflated);
+    free(packed);
+    failed |= fclose(file) != 0;
+    return failed ? -1 : 0;
+}
+
+// Check that the mapped file is a count file this code can read
+static int valid_file(const iterFile *file) {
+    const iterFileHeader *header = file->header;
+    if (file->size < sizeof(iterFileHeader)
+        || memcmp(header->magic, ITERFILE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != ITERFILE_VERSION
+        || header->width <= 0 || header->height <= 0 || header->max < 0
+        || (header->bytes_per_count != 2 && header->bytes_per_count != 4)) {
+        return 0;
+    }
+
+    size_t data = sizeof(iterFileHeader);
+    if (header->compression == ITER_RAW) {
+        return (file->size - data) / header->bytes_per_count / header->width >= (size_t)header->height;
+    }
+    if (header->compression != ITER_DELTA_ZLIB || header->block_rows <= 0) {
+        return 0;
+    }
+    int blocks = num_blocks(header);
+    if ((file->size - data) / sizeof(uint64_t) < (size_t)blocks + 1) {
+        return 0;
+    }
+    for (int b = 0; b <= blocks; ++b) {
+        uint64_t previous = b == 0 ? data + sizeof(uint64_t) * (blocks + 1) : file->offsets[b - 1];
+        if (file->offsets[b] < previous || file->offsets[b] > file->size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+iterFile *openIterFile(const char *fname) {
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);                                                  // The mapping keeps the file open
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    iterFile *file = malloc(sizeof(iterFile));
+    if (file == NULL) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    file->map = map;
+    file->size = st.st_size;
+    file->header = map;
+    file->offsets = (const uint64_t *)(file->map + sizeof(iterFileHeader));
+    if (!valid_file(file)) {
+        closeIterFile(file);
+        return NULL;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    return file;
+}
+
+void closeIterFile(iterFile *file) {
+    munmap((void *)file->map, file->size);
+    free(file);
+}
+
+void getIterFileInfo(const iterFile *file, iterFrameInfo *info) {
+    const iterFileHeader *header = file->header;
+    info->xcenter = header->xcenter;
+    info->ycenter = header->ycenter;
+    info->xscale = header->xscale;
+    info->yscale = header->yscale;
+    info->width = header->width;
+    info->height = header->height;
+    info->max = header->max;
+}
+
+int readIterRows(const iterFile *file, int j0, int rows, int *counts) {
+    const iterFileHeader *header = file->header;
+    int width = header->width;
+    int bpc = header->bytes_per_count;
+    size_t row_bytes = (size_t)width * bpc;
+
+    if (j0 < 0 || rows < 0 || j0 + rows > header->height) {
+        return -1;
+    }
+    if (header->compression == ITER_RAW) {
+        const unsigned char *data = file->map + sizeof(iterFileHeader);
+        for (int j = 0; j < rows; ++j) {
+            unpack_row(counts + (size_t)j * width, data + (j0 + j) * row_bytes, width, bpc, 0, header->max);
+        }
+        return 0;
+    }
+
+    unsigned char *block = malloc(row_bytes * header->block_rows);
+    if (block == NULL) {
+        return -1;
+    }
+    int failed = 0;
+    for (int b = j0 / header->block_rows; b * header->block_rows < j0 + rows && !failed; ++b) {
+        int first = b * header->block_rows;
+        int block_rows = first + header->block_rows < header->height ? header->block_rows : header->height - first;
+        uLongf bytes = row_bytes * block_rows;
+        failed = uncompress(block, &bytes, file->map + file->offsets[b], file->offsets[b + 1] - file->offsets[b]) != Z_OK
+                 || bytes != row_bytes * block_rows;
+        for (int j = first > j0 ? first : j0; j < first + block_rows && j < j0 + rows && !failed; ++j) {
+            unpack_row(counts + (size_t)(j - j0) * width, block + (j - first) * row_bytes, width, bpc, 1, header->max);
+        }
+    }
+    free(block);
+    return failed ? -1 : 0;
+}
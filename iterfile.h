@@ -0,0 +1,67 @@
+#ifndef ITERFILE_H
+#define ITERFILE_H
+
+// Raw iteration counts of a frame, so it can be recolored without
+// iterating it again. Counts are laid out like compute_counts, row 0 at
+// ymin, and stored as 16 bit values when max fits, else 32 bit.
+//
+// A file is an iterFileHeader followed by the counts. Uncompressed, the
+// counts follow the header directly, so a reader that maps the file can
+// use them in place. Compressed, the header is followed by num_blocks+1
+// file offsets (uint64_t) and then the blocks of block_rows rows each,
+// every row delta coded from its left neighbour and every block deflated.
+
+#define ITERFILE_MAGIC "MITR"
+#define ITERFILE_VERSION 1
+#define ITERFILE_BLOCK_ROWS 64
+
+typedef enum iterCompression {
+	ITER_RAW,
+	ITER_DELTA_ZLIB
+} iterCompression;
+
+// What was rendered - enough to tell how a file was made, or to redo it
+typedef struct iterFrameInfo {
+	double xcenter;
+	double ycenter;
+	double xscale;
+	double yscale;
+	int width;
+	int height;
+	int max;                // counts run from 0 to max
+} iterFrameInfo;
+
+// The fixed header at the start of every count file, little endian
+typedef struct iterFileHeader {
+	char magic[4];          // ITERFILE_MAGIC
+	int version;            // ITERFILE_VERSION
+	int width;
+	int height;
+	int max;
+	int bytes_per_count;    // 2 or 4
+	int compression;        // an iterCompression
+	int block_rows;         // rows per compressed block
+	double xcenter;
+	double ycenter;
+	double xscale;
+	double yscale;
+} iterFileHeader;
+
+// Write the width*height counts of a frame to fname. Returns 0 on success.
+int storeIterFile(const char* fname, const int* counts, const iterFrameInfo* info, iterCompression compression);
+
+// A count file mapped into memory for reading
+typedef struct iterFile iterFile;
+
+// Returns NULL if the file can't be mapped or isn't a valid count file.
+iterFile* openIterFile(const char* fname);
+
+void closeIterFile(iterFile* file);
+
+void getIterFileInfo(const iterFile* file, iterFrameInfo* info);
+
+// Decode rows j0 to j0+rows-1 into counts, laid out like compute_counts.
+// Returns 0 on success, or -1 if the rows are out of range or a block is damaged.
+int readIterRows(const iterFile* file, int j0, int rows, int* counts);
+
+#endif  /* Compile guard */
@@ -8,11 +8,28 @@
 ///
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <jpeglib.h>    
+#include <png.h>
 #include <jerror.h>
 #include "jpegrw.h"
 
 #define NUM_COMPONENTS 3   // always 3 for JPG
+#define HUGE_PAGE_SIZE (2UL*1024*1024)
+#define JPEG_BATCH_ROWS 16 // a whole 4:2:0 MCU row per jpeg_write_scanlines
+
+struct imgFramePool {
+	unsigned int count;
+	size_t bufferBytes;     // rounded up to whole huge pages
+	unsigned char* lpMemory;
+	imgRawImage* frames;
+	int* inUse;
+	pthread_mutex_t lock;
+	pthread_cond_t released;
+};
 
 imgRawImage* initRawImage(unsigned int width, unsigned int height)
 {
@@ -36,6 +53,94 @@ void freeRawImage(imgRawImage* img)
 	free(img);
 }
 
+imgFramePool* initFramePool(unsigned int width, unsigned int height, unsigned int count)
+{
+	imgFramePool* pool;
+	size_t bytes = (size_t)width * height * NUM_COMPONENTS;
+
+	pool = (imgFramePool*) calloc(1, sizeof(imgFramePool));
+	if(pool == NULL) {
+		return NULL;
+	}
+	pool->count = count;
+	pool->bufferBytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	// Reserved huge pages first, then normal pages with a hint for
+	// transparent huge pages. MAP_POPULATE takes the page faults now.
+	pool->lpMemory = mmap(NULL, pool->bufferBytes * count, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE | MAP_HUGETLB, -1, 0);
+	if(pool->lpMemory == MAP_FAILED) {
+		pool->lpMemory = mmap(NULL, pool->bufferBytes * count, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(pool->lpMemory == MAP_FAILED) {
+			free(pool);
+			return NULL;
+		}
+		#ifdef MADV_HUGEPAGE
+			madvise(pool->lpMemory, pool->bufferBytes * count, MADV_HUGEPAGE);
+		#endif
+		for(size_t i = 0; i < pool->bufferBytes * count; i += 4096) {
+			pool->lpMemory[i] = 0;
+		}
+	}
+
+	pool->frames = (imgRawImage*) calloc(count, sizeof(imgRawImage));
+	pool->inUse = (int*) calloc(count, sizeof(int));
+	if(pool->frames == NULL || pool->inUse == NULL) {
+		munmap(pool->lpMemory, pool->bufferBytes * count);
+		free(pool->inUse);
+		free(pool->frames);
+		free(pool);
+		return NULL;
+	}
+	for(unsigned int i = 0; i < count; i++) {
+		pool->frames[i].numComponents = NUM_COMPONENTS;
+		pool->frames[i].width = width;
+		pool->frames[i].height = height;
+		pool->frames[i].lpData = pool->lpMemory + i * pool->bufferBytes;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->released, NULL);
+
+	return pool;
+}
+
+void freeFramePool(imgFramePool* pool)
+{
+	if(pool == NULL) {
+		return;
+	}
+	munmap(pool->lpMemory, pool->bufferBytes * pool->count);
+	pthread_cond_destroy(&pool->released);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->inUse);
+	free(pool->frames);
+	free(pool);
+}
+
+imgRawImage* acquireFrame(imgFramePool* pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		for(unsigned int i = 0; i < pool->count; i++) {
+			if(!pool->inUse[i]) {
+				pool->inUse[i] = 1;
+				pthread_mutex_unlock(&pool->lock);
+				return &pool->frames[i];
+			}
+		}
+		pthread_cond_wait(&pool->released, &pool->lock);
+	}
+}
+
+void releaseFrame(imgFramePool* pool, imgRawImage* img)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->inUse[img - pool->frames] = 0;
+	pthread_cond_signal(&pool->released);
+	pthread_mutex_unlock(&pool->lock);
+}
+
 void setImageRGB(imgRawImage* image,unsigned char red,unsigned char green,
 							 unsigned char blue)
 {
@@ -78,6 +183,24 @@ void setPixelCOLOR(imgRawImage* image, unsigned int x, unsigned int y, unsigned
 }
 
 
+void setRowCOLOR(imgRawImage* image, unsigned int x, unsigned int y,
+							 const unsigned int* rgb, unsigned int n)
+{
+	if(y >= image->height || x >= image->width) {
+		return;
+	}
+	if(n > image->width - x) {
+		n = image->width - x;
+	}
+
+	unsigned char* lpPixel = getRowRGB(image, y) + x * image->numComponents;
+	for(unsigned int i = 0; i < n; i++) {
+		lpPixel[0] = (rgb[i] & 0xFF0000) >> 16;
+		lpPixel[1] = (rgb[i] & 0xFF00) >> 8;
+		lpPixel[2] = rgb[i] & 0xFF;
+		lpPixel += image->numComponents;
+	}
+}
 
 imgRawImage* loadJpegImageFile(const char* lpFilename) 
 {
@@ -148,13 +271,99 @@ imgRawImage* loadJpegImageFile(const char* lpFilename)
 
 
 
+int parseJpegOptions(const char* spec, imgJpegOptions* options)
+{
+	char buffer[256];
+	if(strlen(spec) >= sizeof(buffer)) {
+		return -1;
+	}
+	strcpy(buffer, spec);
+
+	char* save = NULL;
+	for(char* item = strtok_r(buffer, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+		char* value = strchr(item, '=');
+		if(value != NULL) {
+			*value++ = '\0';
+		}
+
+		if(strcmp(item, "opt") == 0 && value == NULL) {
+			options->optimize_coding = 1;
+		} else if(strcmp(item, "noopt") == 0 && value == NULL) {
+			options->optimize_coding = 0;
+		} else if(value == NULL) {
+			return -1;
+		} else if(strcmp(item, "q") == 0) {
+			char* end;
+			long quality = strtol(value, &end, 10);
+			if(*end != '\0' || quality < 1 || quality > 100) {
+				return -1;
+			}
+			options->quality = quality;
+		} else if(strcmp(item, "dct") == 0) {
+			if(strcmp(value, "islow") == 0) options->dct = IMG_DCT_ISLOW;
+			else if(strcmp(value, "ifast") == 0 || strcmp(value, "fast") == 0) options->dct = IMG_DCT_IFAST;
+			else if(strcmp(value, "float") == 0) options->dct = IMG_DCT_FLOAT;
+			else return -1;
+		} else if(strcmp(item, "sub") == 0) {
+			if(strcmp(value, "420") == 0) options->subsampling = IMG_SUBSAMPLE_420;
+			else if(strcmp(value, "422") == 0) options->subsampling = IMG_SUBSAMPLE_422;
+			else if(strcmp(value, "444") == 0) options->subsampling = IMG_SUBSAMPLE_444;
+			else return -1;
+		} else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
 int storeJpegImageFile(const imgRawImage* lpImage,const char* lpFilename)
+{
+	const imgJpegOptions defaults = IMG_JPEG_DEFAULTS;
+	return storeJpegImageFileOpts(lpImage, lpFilename, &defaults);
+}
+
+/* Set up a compressor whose destination is already chosen and run it over the image */
+static void compressJpeg(struct jpeg_compress_struct* info, const imgRawImage* lpImage, const imgJpegOptions* options)
+{
+	unsigned char* lpRowBuffer[JPEG_BATCH_ROWS];
+
+	info->image_width = lpImage->width;
+	info->image_height = lpImage->height;
+	info->input_components = 3;
+	info->in_color_space = JCS_RGB;
+
+	jpeg_set_defaults(info);
+	jpeg_set_quality(info, options->quality, TRUE);
+	info->dct_method = options->dct == IMG_DCT_IFAST ? JDCT_IFAST
+	                 : options->dct == IMG_DCT_FLOAT ? JDCT_FLOAT : JDCT_ISLOW;
+	info->optimize_coding = options->optimize_coding ? TRUE : FALSE;
+
+	/* Luma sampling factors, chroma always stays at 1x1 */
+	info->comp_info[0].h_samp_factor = options->subsampling == IMG_SUBSAMPLE_444 ? 1 : 2;
+	info->comp_info[0].v_samp_factor = options->subsampling == IMG_SUBSAMPLE_420 ? 2 : 1;
+
+	jpeg_start_compress(info, TRUE);
+
+	/* Hand the scanlines over a batch at a time ... */
+	while(info->next_scanline < info->image_height) {
+		unsigned int rows = info->image_height - info->next_scanline;
+		if(rows > JPEG_BATCH_ROWS) {
+			rows = JPEG_BATCH_ROWS;
+		}
+		for(unsigned int r = 0; r < rows; r++) {
+			lpRowBuffer[r] = &(lpImage->lpData[(size_t)(info->next_scanline + r) * (lpImage->width * 3)]);
+		}
+		jpeg_write_scanlines(info, lpRowBuffer, rows);
+	}
+
+	jpeg_finish_compress(info);
+}
+
+int storeJpegImageFileOpts(const imgRawImage* lpImage,const char* lpFilename,const imgJpegOptions* options)
 {
 	struct jpeg_compress_struct info;
 	struct jpeg_error_mgr err;
 
-	unsigned char* lpRowBuffer[1];
-
 	FILE* fHandle;
 
 	fHandle = fopen(lpFilename, "wb");
@@ -169,26 +378,199 @@ int storeJpegImageFile(const imgRawImage* lpImage,const char* lpFilename)
 	jpeg_create_compress(&info);
 
 	jpeg_stdio_dest(&info, fHandle);
+	compressJpeg(&info, lpImage, options);
+	fclose(fHandle);
 
-	info.image_width = lpImage->width;
-	info.image_height = lpImage->height;
-	info.input_components = 3;
-	info.in_color_space = JCS_RGB;
+	jpeg_destroy_compress(&info);
+	return 0;
+}
 
-	jpeg_set_defaults(&info);
-	jpeg_set_quality(&info, 100, TRUE);
+/* A growing buffer for encoding PNGs into memory */
+typedef struct pngBuffer {
+	unsigned char* data;
+	size_t size;
+	size_t capacity;
+} pngBuffer;
 
-	jpeg_start_compress(&info, TRUE);
+static void pngBufferWrite(png_structp png, png_bytep data, png_size_t length)
+{
+	pngBuffer* buffer = png_get_io_ptr(png);
+	if(buffer->size + length > buffer->capacity) {
+		size_t capacity = buffer->capacity * 2 > buffer->size + length ? buffer->capacity * 2 : buffer->size + length;
+		unsigned char* grown = realloc(buffer->data, capacity);
+		if(grown == NULL) {
+			png_error(png, "out of memory");
+		}
+		buffer->data = grown;
+		buffer->capacity = capacity;
+	}
+	memcpy(buffer->data + buffer->size, data, length);
+	buffer->size += length;
+}
 
-	/* Write every scanline ... */
-	while(info.next_scanline < info.image_height) {
-		lpRowBuffer[0] = &(lpImage->lpData[info.next_scanline * (lpImage->width * 3)]);
-		jpeg_write_scanlines(&info, lpRowBuffer, 1);
+static void pngBufferFlush(png_structp png)
+{
+}
+
+/* Encode to fHandle, or into buffer when fHandle is NULL */
+static int compressPng(const imgRawImage* lpImage, int level, FILE* fHandle, pngBuffer* buffer)
+{
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info = png ? png_create_info_struct(png) : NULL;
+	if(info == NULL || setjmp(png_jmpbuf(png))) {
+		png_destroy_write_struct(&png, &info);
+		return 1;
 	}
 
-	jpeg_finish_compress(&info);
-	fclose(fHandle);
+	if(fHandle != NULL) {
+		png_init_io(png, fHandle);
+	} else {
+		png_set_write_fn(png, buffer, pngBufferWrite, pngBufferFlush);
+	}
+	png_set_IHDR(png, info, lpImage->width, lpImage->height, 8, PNG_COLOR_TYPE_RGB,
+				 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_set_compression_level(png, level);
+	png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);  /* cheap, and flat runs still compress */
+	png_write_info(png, info);
+
+	for(unsigned int y = 0; y < lpImage->height; y++) {
+		png_write_row(png, &(lpImage->lpData[(size_t)y * lpImage->width * 3]));
+	}
+	png_write_end(png, NULL);
 
-	jpeg_destroy_compress(&info);
+	png_destroy_write_struct(&png, &info);
+	return 0;
+}
+
+int storePngImageFile(const imgRawImage* lpImage,const char* lpFilename,int level)
+{
+	FILE* fHandle = fopen(lpFilename, "wb");
+	if(fHandle == NULL) {
+		return 1;
+	}
+	int failed = compressPng(lpImage, level, fHandle, NULL);
+	failed |= fclose(fHandle) != 0;
+	return failed;
+}
+
+static int storeRgbRows(const imgRawImage* lpImage, const char* lpFilename, int withHeader)
+{
+	FILE* fHandle = fopen(lpFilename, "wb");
+	if(fHandle == NULL) {
+		return 1;
+	}
+
+	size_t bytes = (size_t)lpImage->width * lpImage->height * 3;
+	int failed = withHeader && fprintf(fHandle, "P6\n%u %u\n255\n", lpImage->width, lpImage->height) < 0;
+	failed |= fwrite(lpImage->lpData, 1, bytes, fHandle) != bytes;
+	failed |= fclose(fHandle) != 0;
+	return failed;
+}
+
+int storePpmImageFile(const imgRawImage* lpImage,const char* lpFilename)
+{
+	return storeRgbRows(lpImage, lpFilename, 1);
+}
+
+int storeRawImageFile(const imgRawImage* lpImage,const char* lpFilename)
+{
+	return storeRgbRows(lpImage, lpFilename, 0);
+}
+
+int parseImageFormat(const char* name)
+{
+	if(strcasecmp(name, "jpg") == 0 || strcasecmp(name, "jpeg") == 0) return IMG_FORMAT_JPEG;
+	if(strcasecmp(name, "png") == 0) return IMG_FORMAT_PNG;
+	if(strcasecmp(name, "ppm") == 0) return IMG_FORMAT_PPM;
+	if(strcasecmp(name, "raw") == 0 || strcasecmp(name, "rgb") == 0) return IMG_FORMAT_RAW;
+	return -1;
+}
+
+int imageFormatFromFilename(const char* fname)
+{
+	const char* dot = strrchr(fname, '.');
+	if(dot == NULL || strchr(dot, '/') != NULL) {
+		return -1;
+	}
+	return parseImageFormat(dot + 1);
+}
+
+const char* imageFormatExtension(imgFormat format)
+{
+	switch(format) {
+		case IMG_FORMAT_JPEG: return "jpg";
+		case IMG_FORMAT_PNG:  return "png";
+		case IMG_FORMAT_PPM:  return "ppm";
+		case IMG_FORMAT_RAW:  return "rgb";
+	}
+	return "jpg";
+}
+
+int storeImageFile(const imgRawImage* lpImage,const char* lpFilename,imgFormat format,
+							 const imgJpegOptions* options)
+{
+	const imgJpegOptions defaults = IMG_JPEG_DEFAULTS;
+
+	switch(format) {
+		case IMG_FORMAT_PNG: return storePngImageFile(lpImage, lpFilename, 1);
+		case IMG_FORMAT_PPM: return storePpmImageFile(lpImage, lpFilename);
+		case IMG_FORMAT_RAW: return storeRawImageFile(lpImage, lpFilename);
+		case IMG_FORMAT_JPEG: break;
+	}
+	return storeJpegImageFileOpts(lpImage, lpFilename, options ? options : &defaults);
+}
+
+int encodeImage(const imgRawImage* lpImage,imgFormat format,const imgJpegOptions* options,
+							 unsigned char** data,size_t* size)
+{
+	const imgJpegOptions defaults = IMG_JPEG_DEFAULTS;
+	size_t bytes = (size_t)lpImage->width * lpImage->height * 3;
+
+	*data = NULL;
+	*size = 0;
+	if(format == IMG_FORMAT_JPEG) {
+		struct jpeg_compress_struct info;
+		struct jpeg_error_mgr err;
+		unsigned long length = 0;
+
+		info.err = jpeg_std_error(&err);
+		jpeg_create_compress(&info);
+		jpeg_mem_dest(&info, data, &length);   /* libjpeg mallocs the buffer */
+		compressJpeg(&info, lpImage, options ? options : &defaults);
+		jpeg_destroy_compress(&info);
+		*size = length;
+		return 0;
+	}
+	if(format == IMG_FORMAT_PNG) {
+		pngBuffer buffer = { malloc(bytes / 4 + 1024), 0, bytes / 4 + 1024 };
+		if(buffer.data == NULL || compressPng(lpImage, 1, NULL, &buffer) != 0) {
+			free(buffer.data);
+			return 1;
+		}
+		*data = buffer.data;
+		*size = buffer.size;
+		return 0;
+	}
+
+	char header[64];
+	int headerBytes = format == IMG_FORMAT_PPM ? snprintf(header, sizeof(header), "P6\n%u %u\n255\n", lpImage->width, lpImage->height) : 0;
+	*data = malloc(headerBytes + bytes);
+	if(*data == NULL) {
+		return 1;
+	}
+	memcpy(*data, header, headerBytes);
+	memcpy(*data + headerBytes, lpImage->lpData, bytes);
+	*size = headerBytes + bytes;
 	return 0;
 }
+
+int storeEncodedImage(const char* lpFilename,const unsigned char* data,size_t size)
+{
+	FILE* fHandle = fopen(lpFilename, "wb");
+	if(fHandle == NULL) {
+		return 1;
+	}
+	int failed = fwrite(data, 1, size, fHandle) != size;
+	failed |= fclose(fHandle) != 0;
+	return failed;
+}
@@ -15,11 +15,92 @@ imgRawImage* loadJpegImageFile(const char* fname);
 // writes out jpeg
 int storeJpegImageFile(const imgRawImage* img, const char* lpFilename);
 
+// How storeJpegImageFileOpts encodes. The defaults match storeJpegImageFile:
+// quality 100, the accurate integer DCT, 4:2:0 chroma and the standard
+// Huffman tables. Frames headed straight into a video encoder can use a
+// lower quality and the fast DCT.
+typedef enum imgDctMethod {
+	IMG_DCT_ISLOW,      // accurate integer DCT
+	IMG_DCT_IFAST,      // faster, less accurate integer DCT
+	IMG_DCT_FLOAT
+} imgDctMethod;
+
+typedef enum imgSubsampling {
+	IMG_SUBSAMPLE_420,
+	IMG_SUBSAMPLE_422,
+	IMG_SUBSAMPLE_444   // full resolution chroma
+} imgSubsampling;
+
+typedef struct imgJpegOptions {
+	int quality;            // 1 to 100
+	imgDctMethod dct;
+	imgSubsampling subsampling;
+	int optimize_coding;    // optimal Huffman tables - smaller, but another pass
+} imgJpegOptions;
+
+#define IMG_JPEG_DEFAULTS { 100, IMG_DCT_ISLOW, IMG_SUBSAMPLE_420, 0 }
+
+// Update options from a comma separated list such as "q=90,dct=fast,sub=444,opt".
+// Keys are q (quality), dct (islow, ifast or float), sub (420, 422 or 444)
+// and opt/noopt. Returns 0 on success, -1 on anything it doesn't understand.
+int parseJpegOptions(const char* spec, imgJpegOptions* options);
+
+int storeJpegImageFileOpts(const imgRawImage* img, const char* lpFilename, const imgJpegOptions* options);
+
+// Other ways to store a frame, for pipelines that decode it again right away
+// and don't need to pay for the DCT and Huffman coding.
+// PNG is lossless, deflated at the given zlib level (1 is fastest).
+int storePngImageFile(const imgRawImage* img, const char* lpFilename, int level);
+
+// binary PPM (P6) - a short header and the RGB rows, top row first
+int storePpmImageFile(const imgRawImage* img, const char* lpFilename);
+
+// the bare RGB rows, top row first, as ffmpeg -f rawvideo -pix_fmt rgb24 reads them
+int storeRawImageFile(const imgRawImage* img, const char* lpFilename);
+
+// The output backends storeImageFile can pick from
+typedef enum imgFormat {
+	IMG_FORMAT_JPEG,
+	IMG_FORMAT_PNG,
+	IMG_FORMAT_PPM,
+	IMG_FORMAT_RAW
+} imgFormat;
+
+// a format by name (jpg, jpeg, png, ppm or raw), -1 if unknown
+int parseImageFormat(const char* name);
+
+// the format a filename's extension asks for, -1 if it has none we know
+int imageFormatFromFilename(const char* fname);
+
+// file extension of a format, without the dot
+const char* imageFormatExtension(imgFormat format);
+
+// store in the given format - options only matter for JPEG and may be NULL
+// for the defaults. Returns 0 on success.
+int storeImageFile(const imgRawImage* img, const char* lpFilename, imgFormat format,
+							 const imgJpegOptions* options);
+
 // A few functions to manage raw images
 imgRawImage* initRawImage(unsigned int width, unsigned int height);
 
 void freeRawImage(imgRawImage* img);
 
+// A set of preallocated frame buffers of one size, recycled from frame to
+// frame instead of a malloc/free (and fresh page faults) for every frame.
+// The pixel memory is page aligned, prefaulted, and backed by huge pages
+// when the system has them.
+typedef struct imgFramePool imgFramePool;
+
+imgFramePool* initFramePool(unsigned int width, unsigned int height, unsigned int count);
+
+void freeFramePool(imgFramePool* pool);
+
+// take a free buffer from the pool - waits until another thread releases
+// one if they are all in use
+imgRawImage* acquireFrame(imgFramePool* pool);
+
+void releaseFrame(imgFramePool* pool, imgRawImage* img);
+
 
 void setImageCOLOR(imgRawImage* image,unsigned int rgb);
 
@@ -32,5 +113,27 @@ void setPixelRGB(imgRawImage* image, unsigned int x, unsigned int y,
 							 
 void setPixelCOLOR(imgRawImage* image, unsigned int x, unsigned int y, unsigned int rgb);
 
+// Encode into memory instead of a file, so encoding and writing can be timed
+// (or done) separately. *data is malloc'ed and must be freed by the caller.
+// Returns 0 on success.
+int encodeImage(const imgRawImage* img, imgFormat format, const imgJpegOptions* options,
+							 unsigned char** data, size_t* size);
+
+// write an encoded image to a file
+int storeEncodedImage(const char* lpFilename, const unsigned char* data, size_t size);
+
+// Row oriented access for filling whole rows without the per-pixel call,
+// flip and bounds check. Rows keep the lower-left origin of setPixelRGB:
+// row 0 is the bottom of the image. y must be less than the height.
+static inline unsigned char* getRowRGB(imgRawImage* image, unsigned int y)
+{
+	return image->lpData + (size_t)(image->height - y - 1) * image->width * image->numComponents;
+}
+
+// write n packed 0xRRGGBB colors into row y starting at column x -
+// anything past the edge of the image is dropped
+void setRowCOLOR(imgRawImage* image, unsigned int x, unsigned int y,
+							 const unsigned int* rgb, unsigned int n);
+
 
 #endif  /* Compile guard */
\ No newline at end of file
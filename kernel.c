@@ -0,0 +1,905 @@
+/**************************************************************
+Filename: kernel.c
+Description: The Mandelbrot iteration kernels. The scalar
+iterations_at_point() is the reference; the SIMD versions iterate
+several points at once, freeze each lane as it escapes, and stop
+once every lane is done. They do the same floating point operations
+in the same order, so the counts match the reference exactly
+(built with -ffp-contract=off so nothing gets fused into an FMA).
+The instruction set is picked at runtime, so one binary runs on
+both AVX2 and AVX-512 machines.
+The float kernels are the same loops in single precision, with
+twice the lanes per vector. Their counts are only close to the
+double ones, so they are used where the planner says a frame's
+pixels are far enough apart for float rounding not to show.
+Interior points are the expensive ones, since they always run to
+max. With early-out enabled, points in the main cardioid or the
+period-2 bulb are answered analytically, and an orbit that lands
+exactly on a value it had before (checked against a snapshot
+taken at power-of-two iterations, as in Brent's cycle finding) is
+known to cycle forever and stops with max.
+**************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL 1
+#endif
+
+typedef void (*iterateFunc)(const double *cx, const double *cy, int n, int max, int *iters);
+
+static void iterate_scalar(const double *cx, const double *cy, int n, int max, int *iters);
+static void iterate_scalar_float(const double *cx, const double *cy, int n, int max, int *iters);
+static iterateFunc iterate_impl = iterate_scalar;
+static iterateFunc iterate_float_impl = iterate_scalar_float;
+static int early_out = 1;
+static int blocked = 1;
+
+#define FIRST_SNAPSHOT 8                // iteration of the first cycle-detection snapshot
+#define ESCAPE_CHECK_STEPS 8            // iterations between escape checks in the blocked kernels, divides FIRST_SNAPSHOT
+#define FLOAT_MARGIN 2048               // float is used while pixels are this many float ulps apart
+#define DOUBLE_MARGIN 16384             // and double while they are this many double ulps apart
+// DOUBLE_MARGIN is measured against a __float128 render of 160x90 frames at max
+// 5000. At boundary views such as (-0.7746806106269039, -0.1374168856037867) and
+// (0.001643721971153, -0.822467633298876), double changes under 1% of the pixels
+// at 16384 ulps, but 1-2% at 2048-4096 and 7-36% below 100. Perturbation stays
+// under 0.4% at every spacing. Spiral centers (seahorse -0.7436438870371587,
+// 0.1318259042053120) amplify rounding so much that double still changes 9% at
+// 10^4 ulps and needs about 10^8. No margin on the spacing alone covers those,
+// so mandelmovie -F auto also probes each frame this leaves to double against
+// perturbation (double_holds()).
+
+int parseKernelType(const char *name) {
+    if (strcmp(name, "auto") == 0) return KERNEL_AUTO;
+    if (strcmp(name, "scalar") == 0) return KERNEL_SCALAR;
+    if (strcmp(name, "avx2") == 0) return KERNEL_AVX2;
+    if (strcmp(name, "avx512") == 0) return KERNEL_AVX512;
+    if (strcmp(name, "neon") == 0) return KERNEL_NEON;
+    return -1;
+}
+
+const char *kernelTypeName(kernelType type) {
+    switch (type) {
+        case KERNEL_AUTO:   return "auto";
+        case KERNEL_SCALAR: return "scalar";
+        case KERNEL_AVX2:   return "avx2";
+        case KERNEL_AVX512: return "avx512";
+        case KERNEL_NEON:   return "neon";
+    }
+    return "unknown";
+}
+
+int iterations_at_point(double x, double y, int max) {
+    double x0 = x;
+    double y0 = y;
+    int iter = 0;
+
+    while ((x * x + y * y <= 4) && iter < max) {
+        double xt = x * x - y * y + x0;
+        double yt = 2 * x * y + y0;
+        x = xt;
+        y = yt;
+        iter++;
+    }
+
+    return iter;
+}
+
+void setBlockedKernels(int enabled) {
+    blocked = enabled;
+}
+
+void setEarlyOut(int enabled) {
+    early_out = enabled;
+}
+
+// In the main cardioid or the period-2 bulb, so it never escapes
+static int in_main_bulbs(double x, double y) {
+    double xq = x - 0.25;
+    double q = xq * xq + y * y;
+    if (q * (q + xq) <= 0.25 * y * y) {
+        return 1;
+    }
+    return (x + 1) * (x + 1) + y * y <= 0.0625;
+}
+
+// iterations_at_point with the early-outs - same result, less work inside the set
+static int iterations_early_out(double x, double y, int max) {
+    if (in_main_bulbs(x, y)) {
+        return max;
+    }
+
+    double x0 = x;
+    double y0 = y;
+    double sx = x;
+    double sy = y;
+    int snapshot = FIRST_SNAPSHOT;
+    int iter = 0;
+
+    while ((x * x + y * y <= 4) && iter < max) {
+        double xt = x * x - y * y + x0;
+        double yt = 2 * x * y + y0;
+        x = xt;
+        y = yt;
+        iter++;
+
+        if (x == sx && y == sy) {
+            return max;                                     // orbit is cycling
+        }
+        if (iter == snapshot) {
+            sx = x;
+            sy = y;
+            snapshot <<= 1;
+        }
+    }
+
+    return iter;
+}
+
+static void iterate_scalar(const double *cx, const double *cy, int n, int max, int *iters) {
+    for (int k = 0; k < n; ++k) {
+        iters[k] = early_out ? iterations_early_out(cx[k], cy[k], max)
+                             : iterations_at_point(cx[k], cy[k], max);
+    }
+}
+
+static int in_main_bulbs_float(float x, float y) {
+    float xq = x - 0.25f;
+    float q = xq * xq + y * y;
+    if (q * (q + xq) <= 0.25f * y * y) {
+        return 1;
+    }
+    return (x + 1) * (x + 1) + y * y <= 0.0625f;
+}
+
+// iterations_early_out in single precision - the reference for the float kernels
+static int iterations_float(float x, float y, int max) {
+    if (early_out && in_main_bulbs_float(x, y)) {
+        return max;
+    }
+
+    float x0 = x;
+    float y0 = y;
+    float sx = x;
+    float sy = y;
+    int snapshot = FIRST_SNAPSHOT;
+    int iter = 0;
+
+    while ((x * x + y * y <= 4) && iter < max) {
+        float xt = x * x - y * y + x0;
+        float yt = 2 * x * y + y0;
+        x = xt;
+        y = yt;
+        iter++;
+
+        if (early_out && x == sx && y == sy) {
+            return max;                                     // orbit is cycling
+        }
+        if (iter == snapshot) {
+            sx = x;
+            sy = y;
+            snapshot <<= 1;
+        }
+    }
+
+    return iter;
+}
+
+static void iterate_scalar_float(const double *cx, const double *cy, int n, int max, int *iters) {
+    for (int k = 0; k < n; ++k) {
+        iters[k] = iterations_float((float)cx[k], (float)cy[k], max);
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("avx2")))
+static void iterate_avx2(const double *cx, const double *cy, int n, int max, int *iters) {
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d vmax = _mm256_set1_pd(max);
+    const __m256d quarter = _mm256_set1_pd(0.25);
+    const __m256d sixteenth = _mm256_set1_pd(0.0625);
+    int k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        __m256d x0 = _mm256_loadu_pd(cx + k);
+        __m256d y0 = _mm256_loadu_pd(cy + k);
+        __m256d x = x0;
+        __m256d y = y0;
+        __m256d sx = x0;
+        __m256d sy = y0;
+        __m256d count = _mm256_setzero_pd();
+        __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        int snapshot = FIRST_SNAPSHOT;
+
+        if (early_out) {
+            __m256d yy = _mm256_mul_pd(y0, y0);
+            __m256d xq = _mm256_sub_pd(x0, quarter);
+            __m256d q = _mm256_add_pd(_mm256_mul_pd(xq, xq), yy);
+            __m256d cardioid = _mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, xq)),
+                                             _mm256_mul_pd(quarter, yy), _CMP_LE_OQ);
+            __m256d xb = _mm256_add_pd(x0, one);
+            __m256d bulb = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(xb, xb), yy), sixteenth, _CMP_LE_OQ);
+            __m256d inside = _mm256_or_pd(cardioid, bulb);
+            count = _mm256_and_pd(inside, vmax);
+            active = _mm256_andnot_pd(inside, active);
+        }
+
+        for (int iter = 0; iter < max; ++iter) {
+            __m256d xx = _mm256_mul_pd(x, x);
+            __m256d yy = _mm256_mul_pd(y, y);
+            active = _mm256_and_pd(active, _mm256_cmp_pd(_mm256_add_pd(xx, yy), four, _CMP_LE_OQ));
+            if (_mm256_movemask_pd(active) == 0) {
+                break;
+            }
+            count = _mm256_add_pd(count, _mm256_and_pd(active, one));
+
+            __m256d xt = _mm256_add_pd(_mm256_sub_pd(xx, yy), x0);
+            __m256d yt = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, x), y), y0);
+            x = _mm256_blendv_pd(x, xt, active);            // escaped lanes keep their last value
+            y = _mm256_blendv_pd(y, yt, active);
+
+            if (early_out) {
+                __m256d cycling = _mm256_and_pd(active, _mm256_and_pd(_mm256_cmp_pd(x, sx, _CMP_EQ_OQ),
+                                                                      _mm256_cmp_pd(y, sy, _CMP_EQ_OQ)));
+                count = _mm256_blendv_pd(count, vmax, cycling);
+                active = _mm256_andnot_pd(cycling, active);
+                if (iter + 1 == snapshot) {
+                    sx = x;
+                    sy = y;
+                    snapshot <<= 1;
+                }
+            }
+        }
+        _mm_storeu_si128((__m128i *)(iters + k), _mm256_cvtpd_epi32(count));
+    }
+    iterate_scalar(cx + k, cy + k, n - k, max, iters + k);
+}
+
+__attribute__((target("avx512f")))
+static void iterate_avx512(const double *cx, const double *cy, int n, int max, int *iters) {
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d two = _mm512_set1_pd(2.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d vmax = _mm512_set1_pd(max);
+    const __m512d quarter = _mm512_set1_pd(0.25);
+    const __m512d sixteenth = _mm512_set1_pd(0.0625);
+    int k = 0;
+
+    for (; k + 8 <= n; k += 8) {
+        __m512d x0 = _mm512_loadu_pd(cx + k);
+        __m512d y0 = _mm512_loadu_pd(cy + k);
+        __m512d x = x0;
+        __m512d y = y0;
+        __m512d sx = x0;
+        __m512d sy = y0;
+        __m512d count = _mm512_setzero_pd();
+        __mmask8 active = 0xFF;
+        int snapshot = FIRST_SNAPSHOT;
+
+        if (early_out) {
+            __m512d yy = _mm512_mul_pd(y0, y0);
+            __m512d xq = _mm512_sub_pd(x0, quarter);
+            __m512d q = _mm512_add_pd(_mm512_mul_pd(xq, xq), yy);
+            __mmask8 cardioid = _mm512_cmp_pd_mask(_mm512_mul_pd(q, _mm512_add_pd(q, xq)),
+                                                   _mm512_mul_pd(quarter, yy), _CMP_LE_OQ);
+            __m512d xb = _mm512_add_pd(x0, one);
+            __mmask8 bulb = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(xb, xb), yy), sixteenth, _CMP_LE_OQ);
+            __mmask8 inside = cardioid | bulb;
+            count = _mm512_mask_mov_pd(count, inside, vmax);
+            active &= ~inside;
+        }
+
+        for (int iter = 0; iter < max; ++iter) {
+            __m512d xx = _mm512_mul_pd(x, x);
+            __m512d yy = _mm512_mul_pd(y, y);
+            active = _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(xx, yy), four, _CMP_LE_OQ);
+            if (active == 0) {
+                break;
+            }
+            count = _mm512_mask_add_pd(count, active, count, one);
+
+            __m512d xt = _mm512_add_pd(_mm512_sub_pd(xx, yy), x0);
+            __m512d yt = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, x), y), y0);
+            x = _mm512_mask_blend_pd(active, x, xt);        // escaped lanes keep their last value
+            y = _mm512_mask_blend_pd(active, y, yt);
+
+            if (early_out) {
+                __mmask8 cycling = _mm512_mask_cmp_pd_mask(active, x, sx, _CMP_EQ_OQ) &
+                                   _mm512_mask_cmp_pd_mask(active, y, sy, _CMP_EQ_OQ);
+                count = _mm512_mask_mov_pd(count, cycling, vmax);
+                active &= ~cycling;
+                if (iter + 1 == snapshot) {
+                    sx = x;
+                    sy = y;
+                    snapshot <<= 1;
+                }
+            }
+        }
+        _mm256_storeu_si256((__m256i *)(iters + k), _mm512_cvtpd_epi32(count));
+    }
+    iterate_scalar(cx + k, cy + k, n - k, max, iters + k);
+}
+
+// The blocked kernels do the same iterations, but only look for escapes
+// every ESCAPE_CHECK_STEPS steps. A block where no lane escaped is kept as
+// is; otherwise the vector goes back to the start of it and repeats it one
+// checked step at a time, so every lane still stops at its exact count.
+// Orbits are compared against the cycle snapshot at the block ends only,
+// which finds a cycle a few steps later but gives the same max. The common
+// caps get copies of their own, so -O2 can fold max into the loops.
+#define BLOCKED_VARIANTS(name)                                                                      \
+    static void name(const double *cx, const double *cy, int n, int max, int *iters) {             \
+        switch (max) {                                                                              \
+            case 1000: name##_body(cx, cy, n, 1000, iters); break;                                  \
+            case 2000: name##_body(cx, cy, n, 2000, iters); break;                                  \
+            case 5000: name##_body(cx, cy, n, 5000, iters); break;                                  \
+            default:   name##_body(cx, cy, n, max, iters); break;                                   \
+        }                                                                                           \
+    }
+
+__attribute__((target("avx2"), always_inline))
+static inline void iterate_avx2_blocked_body(const double *cx, const double *cy, int n, const int max, int *iters) {
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d steps = _mm256_set1_pd(ESCAPE_CHECK_STEPS);
+    const __m256d vmax = _mm256_set1_pd(max);
+    const __m256d quarter = _mm256_set1_pd(0.25);
+    const __m256d sixteenth = _mm256_set1_pd(0.0625);
+    const int check_cycles = early_out;
+    int k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        __m256d x0 = _mm256_loadu_pd(cx + k);
+        __m256d y0 = _mm256_loadu_pd(cy + k);
+        __m256d x = x0;
+        __m256d y = y0;
+        __m256d sx = x0;
+        __m256d sy = y0;
+        __m256d count = _mm256_setzero_pd();
+        __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        int snapshot = FIRST_SNAPSHOT;
+
+        if (check_cycles) {
+            __m256d yy = _mm256_mul_pd(y0, y0);
+            __m256d xq = _mm256_sub_pd(x0, quarter);
+            __m256d q = _mm256_add_pd(_mm256_mul_pd(xq, xq), yy);
+            __m256d cardioid = _mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, xq)),
+                                             _mm256_mul_pd(quarter, yy), _CMP_LE_OQ);
+            __m256d xb = _mm256_add_pd(x0, one);
+            __m256d bulb = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(xb, xb), yy), sixteenth, _CMP_LE_OQ);
+            __m256d inside = _mm256_or_pd(cardioid, bulb);
+            count = _mm256_and_pd(inside, vmax);
+            active = _mm256_andnot_pd(inside, active);
+        }
+
+        int iter = 0;
+        while (iter < max && _mm256_movemask_pd(active) != 0) {
+            int block = ESCAPE_CHECK_STEPS;
+            if (iter + ESCAPE_CHECK_STEPS <= max) {
+                __m256d bx = x;
+                __m256d by = y;
+                __m256d escaped = _mm256_setzero_pd();
+                for (int s = 0; s < ESCAPE_CHECK_STEPS; ++s) {
+                    __m256d xx = _mm256_mul_pd(x, x);
+                    __m256d yy = _mm256_mul_pd(y, y);
+                    escaped = _mm256_or_pd(escaped, _mm256_cmp_pd(_mm256_add_pd(xx, yy), four, _CMP_NLE_UQ));
+                    __m256d xt = _mm256_add_pd(_mm256_sub_pd(xx, yy), x0);
+                    y = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, x), y), y0);
+                    x = xt;
+                }
+                if (_mm256_movemask_pd(_mm256_and_pd(escaped, active)) == 0) {
+                    count = _mm256_add_pd(count, _mm256_and_pd(active, steps));
+                    iter += ESCAPE_CHECK_STEPS;
+                    if (check_cycles) {
+                        __m256d cycling = _mm256_and_pd(active, _mm256_and_pd(_mm256_cmp_pd(x, sx, _CMP_EQ_OQ),
+                                                                              _mm256_cmp_pd(y, sy, _CMP_EQ_OQ)));
+                        count = _mm256_blendv_pd(count, vmax, cycling);
+                        active = _mm256_andnot_pd(cycling, active);
+                        if (iter == snapshot) {
+                            sx = x;
+                            sy = y;
+                            snapshot <<= 1;
+                        }
+                    }
+                    continue;
+                }
+                x = bx;                                     // Some lane escaped in the block, redo it checking every step
+                y = by;
+            } else {
+                block = max - iter;
+            }
+
+            for (int s = 0; s < block; ++s, ++iter) {
+                __m256d xx = _mm256_mul_pd(x, x);
+                __m256d yy = _mm256_mul_pd(y, y);
+                active = _mm256_and_pd(active, _mm256_cmp_pd(_mm256_add_pd(xx, yy), four, _CMP_LE_OQ));
+                if (_mm256_movemask_pd(active) == 0) {
+                    break;
+                }
+                count = _mm256_add_pd(count, _mm256_and_pd(active, one));
+
+                __m256d xt = _mm256_add_pd(_mm256_sub_pd(xx, yy), x0);
+                __m256d yt = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, x), y), y0);
+                x = _mm256_blendv_pd(x, xt, active);
+                y = _mm256_blendv_pd(y, yt, active);
+
+                if (check_cycles) {
+                    __m256d cycling = _mm256_and_pd(active, _mm256_and_pd(_mm256_cmp_pd(x, sx, _CMP_EQ_OQ),
+                                                                          _mm256_cmp_pd(y, sy, _CMP_EQ_OQ)));
+                    count = _mm256_blendv_pd(count, vmax, cycling);
+                    active = _mm256_andnot_pd(cycling, active);
+                    if (iter + 1 == snapshot) {
+                        sx = x;
+                        sy = y;
+                        snapshot <<= 1;
+                    }
+                }
+            }
+        }
+        _mm_storeu_si128((__m128i *)(iters + k), _mm256_cvtpd_epi32(count));
+    }
+    iterate_scalar(cx + k, cy + k, n - k, max, iters + k);
+}
+
+__attribute__((target("avx2")))
+BLOCKED_VARIANTS(iterate_avx2_blocked)
+
+__attribute__((target("avx512f"), always_inline))
+static inline void iterate_avx512_blocked_body(const double *cx, const double *cy, int n, const int max, int *iters) {
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d two = _mm512_set1_pd(2.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d steps = _mm512_set1_pd(ESCAPE_CHECK_STEPS);
+    const __m512d vmax = _mm512_set1_pd(max);
+    const __m512d quarter = _mm512_set1_pd(0.25);
+    const __m512d sixteenth = _mm512_set1_pd(0.0625);
+    const int check_cycles = early_out;
+    int k = 0;
+
+    for (; k + 8 <= n; k += 8) {
+        __m512d x0 = _mm512_loadu_pd(cx + k);
+        __m512d y0 = _mm512_loadu_pd(cy + k);
+        __m512d x = x0;
+        __m512d y = y0;
+        __m512d sx = x0;
+        __m512d sy = y0;
+        __m512d count = _mm512_setzero_pd();
+        __mmask8 active = 0xFF;
+        int snapshot = FIRST_SNAPSHOT;
+
+        if (check_cycles) {
+            __m512d yy = _mm512_mul_pd(y0, y0);
+            __m512d xq = _mm512_sub_pd(x0, quarter);
+            __m512d q = _mm512_add_pd(_mm512_mul_pd(xq, xq), yy);
+            __mmask8 cardioid = _mm512_cmp_pd_mask(_mm512_mul_pd(q, _mm512_add_pd(q, xq)),
+                                                   _mm512_mul_pd(quarter, yy), _CMP_LE_OQ);
+            __m512d xb = _mm512_add_pd(x0, one);
+            __mmask8 bulb = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(xb, xb), yy), sixteenth, _CMP_LE_OQ);
+            __mmask8 inside = cardioid | bulb;
+            count = _mm512_mask_mov_pd(count, inside, vmax);
+            active &= ~inside;
+        }
+
+        int iter = 0;
+        while (iter < max && active != 0) {
+            int block = ESCAPE_CHECK_STEPS;
+            if (iter + ESCAPE_CHECK_STEPS <= max) {
+                __m512d bx = x;
+                __m512d by = y;
+                __mmask8 escaped = 0;
+                for (int s = 0; s < ESCAPE_CHECK_STEPS; ++s) {
+                    __m512d xx = _mm512_mul_pd(x, x);
+                    __m512d yy = _mm512_mul_pd(y, y);
+                    escaped |= _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(xx, yy), four, _CMP_NLE_UQ);
+                    __m512d xt = _mm512_add_pd(_mm512_sub_pd(xx, yy), x0);
+                    y = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, x), y), y0);
+                    x = xt;
+                }
+                if (escaped == 0) {
+                    count = _mm512_mask_add_pd(count, active, count, steps);
+                    iter += ESCAPE_CHECK_STEPS;
+                    if (check_cycles) {
+                        __mmask8 cycling = _mm512_mask_cmp_pd_mask(active, x, sx, _CMP_EQ_OQ) &
+                                           _mm512_mask_cmp_pd_mask(active, y, sy, _CMP_EQ_OQ);
+                        count = _mm512_mask_mov_pd(count, cycling, vmax);
+                        active &= ~cycling;
+                        if (iter == snapshot) {
+                            sx = x;
+                            sy = y;
+                            snapshot <<= 1;
+                        }
+                    }
+                    continue;
+                }
+                x = bx;                                     // Some lane escaped in the block, redo it checking every step
+                y = by;
+            } else {
+                block = max - iter;
+            }
+
+            for (int s = 0; s < block; ++s, ++iter) {
+                __m512d xx = _mm512_mul_pd(x, x);
+                __m512d yy = _mm512_mul_pd(y, y);
+                active = _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(xx, yy), four, _CMP_LE_OQ);
+                if (active == 0) {
+                    break;
+                }
+                count = _mm512_mask_add_pd(count, active, count, one);
+
+                __m512d xt = _mm512_add_pd(_mm512_sub_pd(xx, yy), x0);
+                __m512d yt = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, x), y), y0);
+                x = _mm512_mask_blend_pd(active, x, xt);
+                y = _mm512_mask_blend_pd(active, y, yt);
+
+                if (check_cycles) {
+                    __mmask8 cycling = _mm512_mask_cmp_pd_mask(active, x, sx, _CMP_EQ_OQ) &
+                                       _mm512_mask_cmp_pd_mask(active, y, sy, _CMP_EQ_OQ);
+                    count = _mm512_mask_mov_pd(count, cycling, vmax);
+                    active &= ~cycling;
+                    if (iter + 1 == snapshot) {
+                        sx = x;
+                        sy = y;
+                        snapshot <<= 1;
+                    }
+                }
+            }
+        }
+        _mm256_storeu_si256((__m256i *)(iters + k), _mm512_cvtpd_epi32(count));
+    }
+    iterate_scalar(cx + k, cy + k, n - k, max, iters + k);
+}
+
+__attribute__((target("avx512f")))
+BLOCKED_VARIANTS(iterate_avx512_blocked)
+
+__attribute__((target("avx2")))
+static void iterate_avx2_float(const double *cx, const double *cy, int n, int max, int *iters) {
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i vmax = _mm256_set1_epi32(max);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 sixteenth = _mm256_set1_ps(0.0625f);
+    int k = 0;
+
+    for (; k + 8 <= n; k += 8) {
+        __m256 x0 = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(cx + k + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(cx + k)));
+        __m256 y0 = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(cy + k + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(cy + k)));
+        __m256 x = x0;
+        __m256 y = y0;
+        __m256 sx = x0;
+        __m256 sy = y0;
+        __m256i count = _mm256_setzero_si256();             // integer counts, exact past 2^24
+        __m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        int snapshot = FIRST_SNAPSHOT;
+
+        if (early_out) {
+            __m256 yy = _mm256_mul_ps(y0, y0);
+            __m256 xq = _mm256_sub_ps(x0, quarter);
+            __m256 q = _mm256_add_ps(_mm256_mul_ps(xq, xq), yy);
+            __m256 cardioid = _mm256_cmp_ps(_mm256_mul_ps(q, _mm256_add_ps(q, xq)),
+                                            _mm256_mul_ps(quarter, yy), _CMP_LE_OQ);
+            __m256 xb = _mm256_add_ps(x0, one);
+            __m256 bulb = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(xb, xb), yy), sixteenth, _CMP_LE_OQ);
+            __m256 inside = _mm256_or_ps(cardioid, bulb);
+            count = _mm256_and_si256(_mm256_castps_si256(inside), vmax);
+            active = _mm256_andnot_ps(inside, active);
+        }
+
+        for (int iter = 0; iter < max; ++iter) {
+            __m256 xx = _mm256_mul_ps(x, x);
+            __m256 yy = _mm256_mul_ps(y, y);
+            active = _mm256_and_ps(active, _mm256_cmp_ps(_mm256_add_ps(xx, yy), four, _CMP_LE_OQ));
+            if (_mm256_movemask_ps(active) == 0) {
+                break;
+            }
+            count = _mm256_sub_epi32(count, _mm256_castps_si256(active));   // active lanes are -1
+
+            __m256 xt = _mm256_add_ps(_mm256_sub_ps(xx, yy), x0);
+            __m256 yt = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(two, x), y), y0);
+            x = _mm256_blendv_ps(x, xt, active);            // escaped lanes keep their last value
+            y = _mm256_blendv_ps(y, yt, active);
+
+            if (early_out) {
+                __m256 cycling = _mm256_and_ps(active, _mm256_and_ps(_mm256_cmp_ps(x, sx, _CMP_EQ_OQ),
+                                                                     _mm256_cmp_ps(y, sy, _CMP_EQ_OQ)));
+                count = _mm256_blendv_epi8(count, vmax, _mm256_castps_si256(cycling));
+                active = _mm256_andnot_ps(cycling, active);
+                if (iter + 1 == snapshot) {
+                    sx = x;
+                    sy = y;
+                    snapshot <<= 1;
+                }
+            }
+        }
+        _mm256_storeu_si256((__m256i *)(iters + k), count);
+    }
+    iterate_scalar_float(cx + k, cy + k, n - k, max, iters + k);
+}
+
+// two halves of 8 floats as one vector of 16, with AVX-512F alone
+__attribute__((target("avx512f")))
+static inline __m512 widen_ps(__m256 lo, __m256 hi) {
+    return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lo)), _mm256_castps_pd(hi), 1));
+}
+
+__attribute__((target("avx512f")))
+static void iterate_avx512_float(const double *cx, const double *cy, int n, int max, int *iters) {
+    const __m512 four = _mm512_set1_ps(4.0f);
+    const __m512 two = _mm512_set1_ps(2.0f);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512i ione = _mm512_set1_epi32(1);
+    const __m512i vmax = _mm512_set1_epi32(max);
+    const __m512 quarter = _mm512_set1_ps(0.25f);
+    const __m512 sixteenth = _mm512_set1_ps(0.0625f);
+    int k = 0;
+
+    for (; k + 16 <= n; k += 16) {
+        __m512 x0 = widen_ps(_mm512_cvtpd_ps(_mm512_loadu_pd(cx + k)), _mm512_cvtpd_ps(_mm512_loadu_pd(cx + k + 8)));
+        __m512 y0 = widen_ps(_mm512_cvtpd_ps(_mm512_loadu_pd(cy + k)), _mm512_cvtpd_ps(_mm512_loadu_pd(cy + k + 8)));
+        __m512 x = x0;
+        __m512 y = y0;
+        __m512 sx = x0;
+        __m512 sy = y0;
+        __m512i count = _mm512_setzero_si512();
+        __mmask16 active = 0xFFFF;
+        int snapshot = FIRST_SNAPSHOT;
+
+        if (early_out) {
+            __m512 yy = _mm512_mul_ps(y0, y0);
+            __m512 xq = _mm512_sub_ps(x0, quarter);
+            __m512 q = _mm512_add_ps(_mm512_mul_ps(xq, xq), yy);
+            __mmask16 cardioid = _mm512_cmp_ps_mask(_mm512_mul_ps(q, _mm512_add_ps(q, xq)),
+                                                    _mm512_mul_ps(quarter, yy), _CMP_LE_OQ);
+            __m512 xb = _mm512_add_ps(x0, one);
+            __mmask16 bulb = _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_mul_ps(xb, xb), yy), sixteenth, _CMP_LE_OQ);
+            __mmask16 inside = cardioid | bulb;
+            count = _mm512_mask_mov_epi32(count, inside, vmax);
+            active &= ~inside;
+        }
+
+        for (int iter = 0; iter < max; ++iter) {
+            __m512 xx = _mm512_mul_ps(x, x);
+            __m512 yy = _mm512_mul_ps(y, y);
+            active = _mm512_mask_cmp_ps_mask(active, _mm512_add_ps(xx, yy), four, _CMP_LE_OQ);
+            if (active == 0) {
+                break;
+            }
+            count = _mm512_mask_add_epi32(count, active, count, ione);
+
+            __m512 xt = _mm512_add_ps(_mm512_sub_ps(xx, yy), x0);
+            __m512 yt = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(two, x), y), y0);
+            x = _mm512_mask_blend_ps(active, x, xt);        // escaped lanes keep their last value
+            y = _mm512_mask_blend_ps(active, y, yt);
+
+            if (early_out) {
+                __mmask16 cycling = _mm512_mask_cmp_ps_mask(active, x, sx, _CMP_EQ_OQ) &
+                                    _mm512_mask_cmp_ps_mask(active, y, sy, _CMP_EQ_OQ);
+                count = _mm512_mask_mov_epi32(count, cycling, vmax);
+                active &= ~cycling;
+                if (iter + 1 == snapshot) {
+                    sx = x;
+                    sy = y;
+                    snapshot <<= 1;
+                }
+            }
+        }
+        _mm512_storeu_si512((void *)(iters + k), count);
+    }
+    iterate_scalar_float(cx + k, cy + k, n - k, max, iters + k);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+static void iterate_neon(const double *cx, const double *cy, int n, int max, int *iters) {
+    const float64x2_t four = vdupq_n_f64(4.0);
+    const float64x2_t two = vdupq_n_f64(2.0);
+    const uint64x2_t one = vdupq_n_u64(1);
+    const uint64x2_t vmax = vdupq_n_u64(max);
+    const float64x2_t quarter = vdupq_n_f64(0.25);
+    const float64x2_t sixteenth = vdupq_n_f64(0.0625);
+    const float64x2_t fone = vdupq_n_f64(1.0);
+    int k = 0;
+
+    for (; k + 2 <= n; k += 2) {
+        float64x2_t x0 = vld1q_f64(cx + k);
+        float64x2_t y0 = vld1q_f64(cy + k);
+        float64x2_t x = x0;
+        float64x2_t y = y0;
+        float64x2_t sx = x0;
+        float64x2_t sy = y0;
+        uint64x2_t count = vdupq_n_u64(0);
+        uint64x2_t active = vdupq_n_u64(~0ULL);
+        int snapshot = FIRST_SNAPSHOT;
+
+        if (early_out) {
+            float64x2_t yy = vmulq_f64(y0, y0);
+            float64x2_t xq = vsubq_f64(x0, quarter);
+            float64x2_t q = vaddq_f64(vmulq_f64(xq, xq), yy);
+            uint64x2_t cardioid = vcleq_f64(vmulq_f64(q, vaddq_f64(q, xq)), vmulq_f64(quarter, yy));
+            float64x2_t xb = vaddq_f64(x0, fone);
+            uint64x2_t bulb = vcleq_f64(vaddq_f64(vmulq_f64(xb, xb), yy), sixteenth);
+            uint64x2_t inside = vorrq_u64(cardioid, bulb);
+            count = vandq_u64(inside, vmax);
+            active = vbicq_u64(active, inside);
+        }
+
+        for (int iter = 0; iter < max; ++iter) {
+            float64x2_t xx = vmulq_f64(x, x);
+            float64x2_t yy = vmulq_f64(y, y);
+            active = vandq_u64(active, vcleq_f64(vaddq_f64(xx, yy), four));
+            if ((vgetq_lane_u64(active, 0) | vgetq_lane_u64(active, 1)) == 0) {
+                break;
+            }
+            count = vaddq_u64(count, vandq_u64(active, one));
+
+            float64x2_t xt = vaddq_f64(vsubq_f64(xx, yy), x0);
+            float64x2_t yt = vaddq_f64(vmulq_f64(vmulq_f64(two, x), y), y0);
+            x = vbslq_f64(active, xt, x);                   // escaped lanes keep their last value
+            y = vbslq_f64(active, yt, y);
+
+            if (early_out) {
+                uint64x2_t cycling = vandq_u64(active, vandq_u64(vceqq_f64(x, sx), vceqq_f64(y, sy)));
+                count = vbslq_u64(cycling, vmax, count);
+                active = vbicq_u64(active, cycling);
+                if (iter + 1 == snapshot) {
+                    sx = x;
+                    sy = y;
+                    snapshot <<= 1;
+                }
+            }
+        }
+        iters[k] = (int)vgetq_lane_u64(count, 0);
+        iters[k + 1] = (int)vgetq_lane_u64(count, 1);
+    }
+    iterate_scalar(cx + k, cy + k, n - k, max, iters + k);
+}
+
+static void iterate_neon_float(const double *cx, const double *cy, int n, int max, int *iters) {
+    const float32x4_t four = vdupq_n_f32(4.0f);
+    const float32x4_t two = vdupq_n_f32(2.0f);
+    const uint32x4_t one = vdupq_n_u32(1);
+    const uint32x4_t vmax = vdupq_n_u32(max);
+    const float32x4_t quarter = vdupq_n_f32(0.25f);
+    const float32x4_t sixteenth = vdupq_n_f32(0.0625f);
+    const float32x4_t fone = vdupq_n_f32(1.0f);
+    int k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t x0 = vcombine_f32(vcvt_f32_f64(vld1q_f64(cx + k)), vcvt_f32_f64(vld1q_f64(cx + k + 2)));
+        float32x4_t y0 = vcombine_f32(vcvt_f32_f64(vld1q_f64(cy + k)), vcvt_f32_f64(vld1q_f64(cy + k + 2)));
+        float32x4_t x = x0;
+        float32x4_t y = y0;
+        float32x4_t sx = x0;
+        float32x4_t sy = y0;
+        uint32x4_t count = vdupq_n_u32(0);
+        uint32x4_t active = vdupq_n_u32(~0U);
+        int snapshot = FIRST_SNAPSHOT;
+
+        if (early_out) {
+            float32x4_t yy = vmulq_f32(y0, y0);
+            float32x4_t xq = vsubq_f32(x0, quarter);
+            float32x4_t q = vaddq_f32(vmulq_f32(xq, xq), yy);
+            uint32x4_t cardioid = vcleq_f32(vmulq_f32(q, vaddq_f32(q, xq)), vmulq_f32(quarter, yy));
+            float32x4_t xb = vaddq_f32(x0, fone);
+            uint32x4_t bulb = vcleq_f32(vaddq_f32(vmulq_f32(xb, xb), yy), sixteenth);
+            uint32x4_t inside = vorrq_u32(cardioid, bulb);
+            count = vandq_u32(inside, vmax);
+            active = vbicq_u32(active, inside);
+        }
+
+        for (int iter = 0; iter < max; ++iter) {
+            float32x4_t xx = vmulq_f32(x, x);
+            float32x4_t yy = vmulq_f32(y, y);
+            active = vandq_u32(active, vcleq_f32(vaddq_f32(xx, yy), four));
+            if (vmaxvq_u32(active) == 0) {
+                break;
+            }
+            count = vaddq_u32(count, vandq_u32(active, one));
+
+            float32x4_t xt = vaddq_f32(vsubq_f32(xx, yy), x0);
+            float32x4_t yt = vaddq_f32(vmulq_f32(vmulq_f32(two, x), y), y0);
+            x = vbslq_f32(active, xt, x);                   // escaped lanes keep their last value
+            y = vbslq_f32(active, yt, y);
+
+            if (early_out) {
+                uint32x4_t cycling = vandq_u32(active, vandq_u32(vceqq_f32(x, sx), vceqq_f32(y, sy)));
+                count = vbslq_u32(cycling, vmax, count);
+                active = vbicq_u32(active, cycling);
+                if (iter + 1 == snapshot) {
+                    sx = x;
+                    sy = y;
+                    snapshot <<= 1;
+                }
+            }
+        }
+        vst1q_s32(iters + k, vreinterpretq_s32_u32(count));
+    }
+    iterate_scalar_float(cx + k, cy + k, n - k, max, iters + k);
+}
+#endif
+
+kernelType selectKernel(kernelType requested) {
+    kernelType chosen = KERNEL_SCALAR;
+
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    int has_avx512 = __builtin_cpu_supports("avx512f");
+    int has_avx2 = __builtin_cpu_supports("avx2");
+
+    if ((requested == KERNEL_AUTO || requested == KERNEL_AVX512) && has_avx512) {
+        chosen = KERNEL_AVX512;
+    } else if (requested != KERNEL_SCALAR && has_avx2) {
+        chosen = KERNEL_AVX2;
+    }
+#endif
+#ifdef HAVE_NEON_KERNEL
+    if (requested != KERNEL_SCALAR) {
+        chosen = KERNEL_NEON;                               // always there on aarch64
+    }
+#endif
+
+    switch (chosen) {
+#ifdef HAVE_X86_KERNELS
+        case KERNEL_AVX512: iterate_impl = blocked ? iterate_avx512_blocked : iterate_avx512;
+                            iterate_float_impl = iterate_avx512_float; break;
+        case KERNEL_AVX2:   iterate_impl = blocked ? iterate_avx2_blocked : iterate_avx2;
+                            iterate_float_impl = iterate_avx2_float; break;
+#endif
+#ifdef HAVE_NEON_KERNEL
+        case KERNEL_NEON:   iterate_impl = iterate_neon; iterate_float_impl = iterate_neon_float; break;
+#endif
+        default:            iterate_impl = iterate_scalar; iterate_float_impl = iterate_scalar_float; break;
+    }
+    return chosen;
+}
+
+void iterate_points(const double *cx, const double *cy, int n, int max, int *iters) {
+    iterate_impl(cx, cy, n, max, iters);
+}
+
+void iterate_points_float(const double *cx, const double *cy, int n, int max, int *iters) {
+    iterate_float_impl(cx, cy, n, max, iters);
+}
+
+int parsePrecision(const char *name) {
+    if (strcmp(name, "auto") == 0) return PRECISION_AUTO;
+    if (strcmp(name, "float") == 0) return PRECISION_FLOAT;
+    if (strcmp(name, "double") == 0) return PRECISION_DOUBLE;
+    if (strcmp(name, "perturb") == 0) return PRECISION_PERTURB;
+    return -1;
+}
+
+const char *precisionName(precisionType precision) {
+    switch (precision) {
+        case PRECISION_AUTO:    return "auto";
+        case PRECISION_FLOAT:   return "float";
+        case PRECISION_DOUBLE:  return "double";
+        case PRECISION_PERTURB: return "perturb";
+    }
+    return "unknown";
+}
+
+precisionType planPrecision(double spacing, double magnitude) {
+    // Orbits wander out to |z| = 2 whatever the frame, so float rounding is
+    // at least that coarse
+    if (spacing >= fmax(magnitude, 2.0) * FLT_EPSILON * FLOAT_MARGIN) {
+        return PRECISION_FLOAT;
+    }
+    if (spacing >= magnitude * DBL_EPSILON * DOUBLE_MARGIN) {
+        return PRECISION_DOUBLE;
+    }
+    return PRECISION_PERTURB;
+}
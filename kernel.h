@@ -0,0 +1,70 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+// The instruction sets the iteration kernel can run on
+typedef enum kernelType {
+	KERNEL_AUTO,    // best one the CPU supports
+	KERNEL_SCALAR,  // one pixel at a time - the reference implementation
+	KERNEL_AVX2,    // 4 doubles per step
+	KERNEL_AVX512,  // 8 doubles per step
+	KERNEL_NEON     // 2 doubles per step
+} kernelType;
+
+// parse "auto", "scalar", "avx2", "avx512" or "neon" - returns -1 if unknown
+int parseKernelType(const char* name);
+
+const char* kernelTypeName(kernelType type);
+
+// Select the kernel used by iterate_points(). Falls back to the next best
+// instruction set if the CPU (or this build) lacks the requested one and
+// returns the kernel actually selected. Call before any threads start.
+kernelType selectKernel(kernelType requested);
+
+// Turn the blocked AVX2/AVX-512 kernels on or off (on by default). They
+// check for escapes every few iterations instead of after each one, and
+// have copies specialized for max 1000, 2000 and 5000, with the same
+// counts. Off gives the plain kernels to compare against. Call before
+// selectKernel().
+void setBlockedKernels(int enabled);
+
+// Turn the interior early-outs on or off (on by default): the analytic
+// main cardioid / period-2 bulb test and Brent-style cycle detection.
+// Both only ever skip points that would have run to max, so the counts
+// don't change. Call before any threads start.
+void setEarlyOut(int enabled);
+
+// Return the number of iterations at point x, y
+// in the Mandelbrot space, up to a maximum of max.
+int iterations_at_point(double x, double y, int max);
+
+// Iterate n points (cx[k], cy[k]) with the selected kernel, storing the
+// iteration counts in iters. Gives exactly the same counts as
+// iterations_at_point() for every point.
+void iterate_points(const double* cx, const double* cy, int n, int max, int* iters);
+
+// iterate_points in single precision, twice the points per vector. The
+// counts are close to the double ones, but not the same.
+void iterate_points_float(const double* cx, const double* cy, int n, int max, int* iters);
+
+// The arithmetic a frame is iterated with
+typedef enum precisionType {
+	PRECISION_AUTO,     // the cheapest one planPrecision() says is enough
+	PRECISION_FLOAT,
+	PRECISION_DOUBLE,
+	PRECISION_PERTURB   // perturbation against a deep precision reference orbit
+} precisionType;
+
+// parse "auto", "float", "double" or "perturb" - returns -1 if unknown
+int parsePrecision(const char* name);
+
+const char* precisionName(precisionType precision);
+
+// The cheapest precision for a frame whose pixels are spacing apart and
+// whose coordinates are at most magnitude in size: float while the
+// spacing is well above float rounding, double while it is above double
+// rounding, perturbation past that. The spacing can't show an orbit that
+// amplifies double rounding, so check a double pick on the frame itself
+// where a wrong one matters.
+precisionType planPrecision(double spacing, double magnitude);
+
+#endif  /* Compile guard */
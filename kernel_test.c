@@ -0,0 +1,181 @@
+/**************************************************************
+Filename: kernel_test.c
+Description: Checks that every iteration kernel this CPU can run
+gives exactly the counts of the scalar iterations_at_point(), the
+blocked and plain SIMD kernels alike, with the early-outs on and
+off, and that every float kernel gives exactly the counts of the
+scalar float one. The points are random ones over the whole set
+plus points just off the main cardioid and the period-2 bulb,
+where orbits take longest to decide. The caps include the ones the blocked
+kernels have copies for and ones that aren't a multiple of their
+escape check interval. Run with make test.
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "kernel.h"
+
+#define RANDOM_POINTS 20000
+#define BOUNDARY_POINTS 20000
+#define NUM_POINTS (RANDOM_POINTS + BOUNDARY_POINTS)
+
+static const int caps[] = { 1, 7, 8, 9, 1000, 1003, 2000, 5000 };
+static const kernelType kernels[] = { KERNEL_SCALAR, KERNEL_AVX2, KERNEL_AVX512, KERNEL_NEON };
+
+typedef void (*iterateFn)(const double *cx, const double *cy, int n, int max, int *iters);
+
+static double random_between(double low, double high) {
+    return low + (high - low) * (rand() / (double)RAND_MAX);
+}
+
+/*
+Fill cx and cy with the test points
+*/
+static void make_points(double *cx, double *cy) {
+    srand(1);                                                       // The same points every run
+    for (int k = 0; k < RANDOM_POINTS; ++k) {
+        cx[k] = random_between(-2.0, 1.0);
+        cy[k] = random_between(-1.5, 1.5);
+    }
+    for (int k = RANDOM_POINTS; k < NUM_POINTS; ++k) {
+        double t = random_between(0.0, 2 * M_PI);
+        double offset = pow(10.0, random_between(-12.0, -2.0)) * (rand() & 1 ? 1 : -1);
+        if (k & 1) {
+            double r = 0.5 * (1 - cos(t)) * (1 + offset);               // Main cardioid, in polar form around 1/4
+            cx[k] = 0.25 + r * cos(t);
+            cy[k] = r * sin(t);
+        } else {
+            cx[k] = -1 + 0.25 * (1 + offset) * cos(t);                  // Period-2 bulb
+            cy[k] = 0.25 * (1 + offset) * sin(t);
+        }
+    }
+}
+
+/*
+Iterate every point at cap in uneven batches, so partial vectors get tested
+*/
+static void run_cap(iterateFn iterate, const double *cx, const double *cy, int cap, int *iters) {
+    int done = 0;
+    for (int n = 1; done < NUM_POINTS; ++n) {
+        int batch = n % 37 + 1 < NUM_POINTS - done ? n % 37 + 1 : NUM_POINTS - done;
+        iterate(cx + done, cy + done, batch, cap, iters + done);
+        done += batch;
+    }
+}
+
+/*
+Compare the selected kernel's iterate against the reference counts for every cap. Returns the
+number of points that differ.
+*/
+static int check_kernel(const char *name, iterateFn iterate, const double *cx, const double *cy, int *iters,
+                        int **expected) {
+    int failures = 0;
+    for (int c = 0; c < sizeof(caps) / sizeof(caps[0]); ++c) {
+        run_cap(iterate, cx, cy, caps[c], iters);
+        int differ = 0;
+        for (int k = 0; k < NUM_POINTS; ++k) {
+            if (iters[k] != expected[c][k]) {
+                if (differ == 0) {
+                    printf("FAIL %s max=%d: (%.17g, %.17g) gives %d, not %d\n", name, caps[c], cx[k], cy[k], iters[k],
+                           expected[c][k]);
+                }
+                differ++;
+            }
+        }
+        if (differ > 0) {
+            printf("FAIL %s max=%d: %d of %d points differ\n", name, caps[c], differ, NUM_POINTS);
+        }
+        failures += differ;
+    }
+    return failures;
+}
+
+/*
+Check the selected kernel against the references and print the outcome. Returns the number of
+points that differ.
+*/
+static int report_kernel(const char *name, iterateFn iterate, const double *cx, const double *cy, int *iters,
+                         int **expected) {
+    int differ = check_kernel(name, iterate, cx, cy, iters, expected);
+    printf("%s %s: %d points, %d caps\n", differ ? "FAIL" : "ok  ", name, NUM_POINTS, (int)(sizeof(caps) / sizeof(caps[0])));
+    return differ;
+}
+
+int main(void) {
+    int num_caps = sizeof(caps) / sizeof(caps[0]);
+    double *cx = malloc(sizeof(double) * NUM_POINTS);
+    double *cy = malloc(sizeof(double) * NUM_POINTS);
+    int *iters = malloc(sizeof(int) * NUM_POINTS);
+    int *expected[num_caps];
+    int *expected_float[2][num_caps];                               // Scalar float counts, without and with early-outs
+    if (cx == NULL || cy == NULL || iters == NULL) {
+        fprintf(stderr, "kernel_test: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    make_points(cx, cy);
+    for (int c = 0; c < num_caps; ++c) {
+        expected[c] = malloc(sizeof(int) * NUM_POINTS);
+        if (expected[c] == NULL) {
+            fprintf(stderr, "kernel_test: out of memory\n");
+            return EXIT_FAILURE;
+        }
+        for (int k = 0; k < NUM_POINTS; ++k) {
+            expected[c][k] = iterations_at_point(cx[k], cy[k], caps[c]);
+        }
+        for (int early_out = 0; early_out < 2; ++early_out) {
+            expected_float[early_out][c] = malloc(sizeof(int) * NUM_POINTS);
+            if (expected_float[early_out][c] == NULL) {
+                fprintf(stderr, "kernel_test: out of memory\n");
+                return EXIT_FAILURE;
+            }
+            setEarlyOut(early_out);
+            selectKernel(KERNEL_SCALAR);
+            run_cap(iterate_points_float, cx, cy, caps[c], expected_float[early_out][c]);
+        }
+    }
+
+    int failures = 0;
+    int checked = 0;
+    for (int i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        for (int blocked = 1; blocked >= 0; --blocked) {
+            for (int early_out = 1; early_out >= 0; --early_out) {
+                setBlockedKernels(blocked);
+                setEarlyOut(early_out);
+                if (selectKernel(kernels[i]) != kernels[i]) {
+                    continue;                                       // Not on this CPU or in this build
+                }
+                if (kernels[i] == KERNEL_SCALAR && !blocked) {
+                    continue;                                       // Only the SIMD kernels have a plain variant
+                }
+                char name[64];
+                snprintf(name, sizeof(name), "%s%s%s", kernelTypeName(kernels[i]), blocked ? "" : "-plain",
+                         early_out ? "" : " -E");
+                failures += report_kernel(name, iterate_points, cx, cy, iters, expected);
+                checked++;
+            }
+        }
+        for (int early_out = 1; early_out >= 0; --early_out) {
+            setBlockedKernels(1);
+            setEarlyOut(early_out);
+            if (selectKernel(kernels[i]) != kernels[i]) {
+                continue;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "%s-float%s", kernelTypeName(kernels[i]), early_out ? "" : " -E");
+            failures += report_kernel(name, iterate_points_float, cx, cy, iters, expected_float[early_out]);
+            checked++;
+        }
+    }
+
+    for (int c = 0; c < num_caps; ++c) {
+        free(expected[c]);
+        free(expected_float[0][c]);
+        free(expected_float[1][c]);
+    }
+    free(iters);
+    free(cy);
+    free(cx);
+    printf("kernel_test: %d kernel variants checked, %s\n", checked, failures ? "FAILED" : "all counts match");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
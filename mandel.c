@@ -8,14 +8,29 @@
 ///
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "jpegrw.h"
+#include "render.h"
+#include "kernel.h"
+#include "palette.h"
+#include "iterfile.h"
+
+// What the progressive preview needs to write out each level
+typedef struct previewLevels {
+	renderPool* pool;
+	const colorPalette* palette;
+	const char* outfile;
+	int format;
+	const imgJpegOptions* jpeg;
+	int width;
+	int height;
+	struct timespec start;
+} previewLevels;
 
 // local routines
-static int iteration_to_color( int i, int max );
-static int iterations_at_point( double x, double y, int max );
-static void compute_image( imgRawImage *img, double xmin, double xmax,
-									double ymin, double ymax, int max );
+static void write_level(void* context, const int* counts, int stride);
 static void show_help();
 
 
@@ -33,11 +48,22 @@ int main( int argc, char *argv[] )
 	int    image_width = 1000;
 	int    image_height = 1000;
 	int    max = 1000;
+	int    num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	kernelType kernel = KERNEL_AUTO;
+	const char *palette_file = NULL;
+	int    early_out = 1;
+	int    solid_fill = 0;
+	int    mirror = 1;
+	const char *countfile = NULL;
+	iterCompression count_compression = ITER_RAW;
+	imgJpegOptions jpeg = IMG_JPEG_DEFAULTS;
+	int    format = -1; // from the outfile extension unless -f is given
+	int    progressive = 0;
 
 	// For each command line argument given,
 	// override the appropriate configuration value.
 
-	while((c = getopt(argc,argv,"x:y:s:W:H:m:o:h"))!=-1) {
+	while((c = getopt(argc,argv,"x:y:s:W:H:m:o:f:t:k:C:I:ZJ:GEMYh"))!=-1) {
 		switch(c) 
 		{
 			case 'x':
@@ -61,6 +87,50 @@ int main( int argc, char *argv[] )
 			case 'o':
 				outfile = optarg;
 				break;
+			case 'f':
+				format = parseImageFormat(optarg);
+				if(format<0) {
+					fprintf(stderr,"mandel: unknown output format %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 't':
+				num_threads = atoi(optarg);
+				break;
+			case 'k':
+				if(parseKernelType(optarg)<0) {
+					fprintf(stderr,"mandel: unknown kernel %s\n",optarg);
+					exit(1);
+				}
+				kernel = parseKernelType(optarg);
+				break;
+			case 'C':
+				palette_file = optarg;
+				break;
+			case 'I':
+				countfile = optarg;
+				break;
+			case 'Z':
+				count_compression = ITER_DELTA_ZLIB;
+				break;
+			case 'J':
+				if(parseJpegOptions(optarg,&jpeg)<0) {
+					fprintf(stderr,"mandel: bad JPEG options %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'G':
+				progressive = 1;
+				break;
+			case 'E':
+				early_out = 0;
+				break;
+			case 'M':
+				solid_fill = 1;
+				break;
+			case 'Y':
+				mirror = 0;
+				break;
 			case 'h':
 				show_help();
 				exit(1);
@@ -68,11 +138,35 @@ int main( int argc, char *argv[] )
 		}
 	}
 
+	// Without -f the extension picks the output format, JPEG if it's not one we know.
+	if(format<0) {
+		format = imageFormatFromFilename(outfile);
+	}
+	if(format<0) {
+		format = IMG_FORMAT_JPEG;
+	}
+
 	// Calculate y scale based on x scale (settable) and image sizes in X and Y (settable)
 	yscale = xscale / image_width * image_height;
 
+	// Pick the iteration kernel for this CPU.
+	kernel = selectKernel(kernel);
+	setEarlyOut(early_out);
+	setSolidFill(solid_fill);
+	setMirror(mirror);
+
 	// Display the configuration of the image.
-	printf("mandel: x=%lf y=%lf xscale=%lf yscale=%1f max=%d outfile=%s\n",xcenter,ycenter,xscale,yscale,max,outfile);
+	printf("mandel: x=%lf y=%lf xscale=%lf yscale=%1f max=%d threads=%d kernel=%s outfile=%s\n",xcenter,ycenter,xscale,yscale,max,num_threads,kernelTypeName(kernel),outfile);
+
+	// Build the color for every iteration count up front.
+	colorPalette* palette = palette_file ? loadPaletteFile(palette_file,max) : initGrayPalette(max);
+	if(!palette) {
+		fprintf(stderr,"mandel: couldn't load palette %s\n",palette_file);
+		exit(1);
+	}
+
+	// Start the threads that share the rows of the image.
+	renderPool* pool = initRenderPool(num_threads);
 
 	// Create a raw image of the appropriate size.
 	imgRawImage* img = initRawImage(image_width,image_height);
@@ -80,14 +174,41 @@ int main( int argc, char *argv[] )
 	// Fill it with a black
 	setImageCOLOR(img,0);
 
-	// Compute the Mandelbrot image
-	compute_image(img,xcenter-xscale/2,xcenter+xscale/2,ycenter-yscale/2,ycenter+yscale/2,max);
+	// Compute the iteration counts of the Mandelbrot image, then color them
+	renderStats stats;
+	int* counts = malloc(sizeof(int)*image_width*image_height);
+	if(progressive) {
+		// Coarser levels first, each written out as soon as it is done.
+		previewLevels levels = { pool, palette, outfile, format, &jpeg, image_width, image_height };
+		clock_gettime(CLOCK_MONOTONIC,&levels.start);
+		compute_counts_progressive(pool,counts,image_width,image_height,xcenter-xscale/2,xcenter+xscale/2,ycenter-yscale/2,ycenter+yscale/2,NULL,max,write_level,&levels);
+		stats.pixels_skipped = 0;
+	} else {
+		compute_counts(pool,counts,image_width,image_height,xcenter-xscale/2,xcenter+xscale/2,ycenter-yscale/2,ycenter+yscale/2,max,&stats);
+	}
+	colorize_counts(pool,img,counts,palette);
+	if(solid_fill && !progressive) {
+		printf("mandel: solid fill skipped %ld of %ld pixels\n",stats.pixels_skipped,(long)image_width*image_height);
+	}
+	if(!progressive && stats.pixels_mirrored>0) {
+		printf("mandel: mirrored %ld of %ld pixels across the real axis\n",stats.pixels_mirrored,(long)image_width*image_height);
+	}
+
+	// Keep the raw counts for recoloring if asked to.
+	iterFrameInfo info = { xcenter, ycenter, xscale, yscale, image_width, image_height, max };
+	if(countfile && storeIterFile(countfile,counts,&info,count_compression)!=0) {
+		fprintf(stderr,"mandel: couldn't write %s\n",countfile);
+		exit(1);
+	}
 
 	// Save the image in the stated file.
-	storeJpegImageFile(img,outfile);
+	storeImageFile(img,outfile,format,&jpeg);
 
 	// free the mallocs
+	free(counts);
 	freeRawImage(img);
+	freeRenderPool(pool);
+	freePalette(palette);
 
 	return 0;
 }
@@ -95,76 +216,31 @@ int main( int argc, char *argv[] )
 
 
 
-/*
-Return the number of iterations at point x, y
-in the Mandelbrot space, up to a maximum of max.
-*/
-
-int iterations_at_point( double x, double y, int max )
+// Write a finished progressive level as <outfile>_1of<N>.<ext>, N being the share of pixels iterated
+void write_level(void* context, const int* counts, int stride)
 {
-	double x0 = x;
-	double y0 = y;
-
-	int iter = 0;
-
-	while( (x*x + y*y <= 4) && iter < max ) {
-
-		double xt = x*x - y*y + x0;
-		double yt = 2*x*y + y0;
-
-		x = xt;
-		y = yt;
-
-		iter++;
+	previewLevels* levels = context;
+	if(stride==1) {
+		return;  // the full image is stored as usual
 	}
 
-	return iter;
-}
-
-/*
-Compute an entire Mandelbrot image, writing each point to the given bitmap.
-Scale the image to the range (xmin-xmax,ymin-ymax), limiting iterations to "max"
-*/
-
-void compute_image(imgRawImage* img, double xmin, double xmax, double ymin, double ymax, int max )
-{
-	int i,j;
-
-	int width = img->width;
-	int height = img->height;
-
-	// For every pixel in the image...
-
-	for(j=0;j<height;j++) {
-
-		for(i=0;i<width;i++) {
-
-			// Determine the point in x,y space for that pixel.
-			double x = xmin + i*(xmax-xmin)/width;
-			double y = ymin + j*(ymax-ymin)/height;
-
-			// Compute the iterations at that point.
-			int iters = iterations_at_point(x,y,max);
-
-			// Set the pixel in the bitmap.
-			setPixelCOLOR(img,i,j,iteration_to_color(iters,max));
-		}
-	}
-}
+	char levelfile[512];
+	const char* dot = strrchr(levels->outfile,'.');
+	int base = dot ? (int)(dot-levels->outfile) : (int)strlen(levels->outfile);
+	snprintf(levelfile,sizeof(levelfile),"%.*s_1of%d%s",base,levels->outfile,stride*stride,dot ? dot : "");
 
+	imgRawImage* img = initRawImage((levels->width+stride-1)/stride,(levels->height+stride-1)/stride);
+	colorize_level(levels->pool,img,counts,levels->width,stride,levels->palette);
+	storeImageFile(img,levelfile,levels->format,levels->jpeg);
+	freeRawImage(img);
 
-/*
-Convert a iteration number to a color.
-Here, we just scale to gray with a maximum of imax.
-Modify this function to make more interesting colors.
-*/
-int iteration_to_color( int iters, int max )
-{
-	int color = 0xFFFFFF*iters/(double)max;
-	return color;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	printf("mandel: preview %s after %.1f ms\n",levelfile,
+		   (now.tv_sec-levels->start.tv_sec)*1e3+(now.tv_nsec-levels->start.tv_nsec)/1e6);
+	fflush(stdout);
 }
 
-
 // Show help message
 void show_help()
 {
@@ -176,7 +252,18 @@ void show_help()
 	printf("-s <scale>  Scale of the image in Mandlebrot coordinates (X-axis). (default=4)\n");
 	printf("-W <pixels> Width of the image in pixels. (default=1000)\n");
 	printf("-H <pixels> Height of the image in pixels. (default=1000)\n");
-	printf("-o <file>   Set output file. (default=mandel.bmp)\n");
+	printf("-o <file>   Set output file. (default=mandel.jpg)\n");
+	printf("-f <format> Output format: jpg, png, ppm or raw. (default=from the -o extension, else jpg)\n");
+	printf("-t <threads> Number of threads rendering the image. (default=all CPU threads)\n");
+	printf("-k <kernel> Iteration kernel: auto, scalar, avx2, avx512 or neon. (default=auto)\n");
+	printf("-C <file>   Palette file of RRGGBB hex colors. (default=grayscale)\n");
+	printf("-I <file>   Also save the raw iteration counts to file for recoloring.\n");
+	printf("-Z          Delta code and compress the saved counts.\n");
+	printf("-J <opts>   JPEG encoding, e.g. q=90,dct=ifast,sub=444,opt. (default=q=100,dct=islow,sub=420)\n");
+	printf("-G          Progressive: write 1/16 and 1/4 resolution previews (<file>_1of16, _1of4) first.\n");
+	printf("-E          Disable the cardioid/bulb and cycle detection early-outs.\n");
+	printf("-M          Mariani-Silver solid fill of rectangles with a uniform border.\n");
+	printf("-Y          Iterate every row instead of copying the rows mirrored across the real axis.\n");
 	printf("-h          Show this help text.\n");
 	printf("\nSome examples are:\n");
 	printf("mandel -x -0.5 -y -0.5 -s 0.2\n");
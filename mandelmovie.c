@@ -1,225 +1,1668 @@
-/**************************************************************
-Filename: mandelmovie.c 
-Description: This program generates a zooming animation of the 
-Mandelbrot set using multi-processing. The final result is a 
-sequence of images that can be combined into a 4K 30 FPS movie.
-Author: Cade Andrae
-Date: 11/26/24
-Compile Instructions: gcc -o mandelmovie mandelmovie.c jpegrw.c -ljpeg -lm
-Test Instructions:
-- ./mandelmovie -x -0.743643 -y 0.131825 -s 4 -W 3840 -H 2160 -m 1000 -n 300 -p <num_processes>
--  ffmpeg -framerate 30 -i mandel%d.jpg -c:v libx264 -pix_fmt yuv420p -crf 18 -preset slow mandelzoom.mp4
-**************************************************************/
-
-#include <math.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <string.h>
-#include "jpegrw.h"
-
-static int iteration_to_color(int i, int max);
-static int iterations_at_point(double x, double y, int max);
-static void compute_image(imgRawImage *img, double xmin, double xmax, double ymin, double ymax, int max);
-static void show_help();
-
-int main(int argc, char *argv[]) {
-    char c;
-    double xcenter = -0.743643;
-    double ycenter = 0.131825;
-    double xscale = 4.0;                                // Start at the default scale
-    int image_width = 3840;                             // 4K width
-    int image_height = 2160;                            // 4K height
-    int max_iterations = 1000;
-    int num_images = 300;                               // Create 300 images for 30 FPS, 10 seconds of video
-    int num_processes = sysconf(_SC_NPROCESSORS_ONLN);  // Default to all available CPU threads
-    char outfile_base[256] = "mandel";
-    int preview_final = 0;                              // Flag for previewing the final image
-
-    while ((c = getopt(argc, argv, "x:y:s:W:H:m:o:p:n:hP")) != -1) {
-        switch (c) {
-            case 'x':
-                xcenter = atof(optarg);
-                break;
-            case 'y':
-                ycenter = atof(optarg);
-                break;
-            case 's':
-                xscale = atof(optarg);
-                break;
-            case 'W':
-                image_width = atoi(optarg);
-                break;
-            case 'H':
-                image_height = atoi(optarg);
-                break;
-            case 'm':
-                max_iterations = atoi(optarg);
-                break;
-            case 'o':
-                strncpy(outfile_base, optarg, sizeof(outfile_base) - 1);
-                outfile_base[sizeof(outfile_base) - 1] = '\0';
-                break;
-            case 'p':
-                num_processes = atoi(optarg);
-                break;
-            case 'n':
-                num_images = atoi(optarg);
-                break;
-            case 'P':
-                preview_final = 1;
-                break;
-            case 'h':
-                show_help();
-                exit(1);
-                break;
-        }
-    }
-
-    double yscale = xscale / image_width * image_height;                        	        // Calculate y scale based on x scale (settable) and image sizes in X and Y (settable)
-    double final_scale = 1e-3;                                                              // Final scale for a deeper zoom
-    double zoom_factor = pow(final_scale / xscale, 1.0 / num_images);
-
-    // If preview_final, generate only the last image
-    if (preview_final) {
-        double final_scale = xscale * pow(zoom_factor, num_images - 1);
-        double ymin = ycenter - final_scale / 2;
-        double ymax = ycenter + final_scale / 2;
-        double xmin = xcenter - final_scale / 2;
-        double xmax = xcenter + final_scale / 2;
-
-        char final_outfile[256];
-        size_t max_base_length = sizeof(final_outfile) - strlen("_final.jpg") - 1;
-        if (strlen(outfile_base) > max_base_length) {
-            fprintf(stderr, "Error: Base filename too long. Truncating.\n");
-            strncpy(final_outfile, outfile_base, max_base_length);
-            final_outfile[max_base_length] = '\0';
-        } else {
-            strcpy(final_outfile, outfile_base);
-        }
-        strcat(final_outfile, "_final.jpg");
-
-        imgRawImage *img = initRawImage(image_width, image_height);                         // Create a raw image of the appropriate size.
-        compute_image(img, xmin, xmax, ymin, ymax, max_iterations);                         // Compute the Mandelbrot image
-        storeJpegImageFile(img, final_outfile);                                             // Save the image in the stated file.
-        freeRawImage(img);                                                                  // free the mallocs
-
-
-        printf("Generated final preview image: %s\n", final_outfile);
-        exit(0);
-    }
-
-    printf("mandelmovie: x=%lf y=%lf xscale=%lf yscale=%lf max=%d images=%d processes=%d\n",
-           xcenter, ycenter, xscale, yscale, max_iterations, num_images, num_processes);
-
-    pid_t pids[num_processes];
-    int images_per_process = num_images / num_processes;
-    int remainder_images = num_images % num_processes;                                      // For uneven division of images
-
-    for (int p = 0; p < num_processes; ++p) {
-        if ((pids[p] = fork()) == 0) {                                                      // Child process
-            int start = p * images_per_process;
-            int end = start + images_per_process;
-            if (p == num_processes - 1) {
-                end += remainder_images;                                                    // Last process gets extra images
-            }
-            for (int i = start; i < end; ++i) {
-                double scale = xscale * pow(zoom_factor, i);
-                char outfile[256];
-                if (snprintf(outfile, sizeof(outfile), "%s%d.jpg", outfile_base, i) >= sizeof(outfile)) {
-                    fprintf(stderr, "Error: Output filename too long or truncated.\n");
-                    exit(EXIT_FAILURE);
-                }
-
-                double ymin = ycenter - scale / 2;
-                double ymax = ycenter + scale / 2;
-                double xmin = xcenter - scale / 2;
-                double xmax = xcenter + scale / 2;
-
-                imgRawImage *img = initRawImage(image_width, image_height);                 // Create a raw image of the appropriate size.
-                compute_image(img, xmin, xmax, ymin, ymax, max_iterations);                 // Compute the Mandelbrot image
-                storeJpegImageFile(img, outfile);                                           // Save the image in the stated file.
-                freeRawImage(img);                                                          // free the mallocs
-                printf("Generated: %s\n", outfile);
-            }
-            exit(0);
-        }
-    }
-
-    // Parent process waits for all children to complete
-    for (int p = 0; p < num_processes; ++p) {
-        waitpid(pids[p], NULL, 0);
-    }
-    printf("All images generated. Use ffmpeg to create the movie:\n");
-    printf("ffmpeg -framerate 30 -i %s%%d.jpg -pix_fmt yuv420p mandelzoom.mp4\n", outfile_base);
-    return 0;
-}
-
-/*
-Return the number of iterations at point x, y
-in the Mandelbrot space, up to a maximum of max.
-*/
-int iterations_at_point(double x, double y, int max) {
-    double x0 = x;
-    double y0 = y;
-    int iter = 0;
-
-    while ((x * x + y * y <= 4) && iter < max) {
-        double xt = x * x - y * y + x0;
-        double yt = 2 * x * y + y0;
-        x = xt;
-        y = yt;
-        iter++;
-    }
-
-    return iter;
-}
-
-/*
-Compute an entire Mandelbrot image, writing each point to the given bitmap.
-Scale the image to the range (xmin-xmax,ymin-ymax), limiting iterations to "max"
-*/
-void compute_image(imgRawImage *img, double xmin, double xmax, double ymin, double ymax, int max) {
-    int width = img->width;
-    int height = img->height;
-
-    for (int j = 0; j < height; ++j) {
-        for (int i = 0; i < width; ++i) {
-            double x = xmin + i * (xmax - xmin) / width;
-            double y = ymin + j * (ymax - ymin) / height;
-            int iters = iterations_at_point(x, y, max);
-            setPixelCOLOR(img, i, j, iteration_to_color(iters, max));
-        }
-    }
-}
-
-//Convert a iteration number to a color.
-int iteration_to_color(int iters, int max) {
-    if (iters == max) return 0x000000;
-
-    double t = (double)iters / max;
-    unsigned char red = (unsigned char)(9 * (1 - t) * pow(t, 3) * 255);
-    unsigned char green = (unsigned char)(15 * pow((1 - t), 2) * pow(t, 2) * 255);
-    unsigned char blue = (unsigned char)(8.5 * pow((1 - t), 3) * t * 255);
-
-    return (red << 16) | (green << 8) | blue;
-}
-
-// Show help message
-void show_help() {
-    printf("Usage: mandelmovie [options]\n");
-    printf("Options:\n");
-    printf("  -x <coord>  X coordinate of image center. Default: -0.743643\n");
-    printf("  -y <coord>  Y coordinate of image center. Default: 0.131825\n");
-    printf("  -s <scale>  Initial scale. Default: 4\n");
-    printf("  -W <width>  Image width in pixels. Default: 3840 (4K)\n");
-    printf("  -H <height> Image height in pixels. Default: 2160 (4K)\n");
-    printf("  -m <max>    Max iterations. Default: 1000\n");
-    printf("  -o <base>   Output filename base. Default: mandel\n");
-    printf("  -p <procs>  Number of processes. Default: all CPU threads\n");
-    printf("  -n <images> Number of images. Default: 300\n");
-    printf("  -P          Preview the final image only.\n");
-    printf("  -h          Show help.\n");
-}
+/**************************************************************
+Filename: mandelmovie.c 
+Description: This program generates a zooming animation of the 
+Mandelbrot set using multi-processing. The final result is a 
+sequence of images that can be combined into a 4K 30 FPS movie.
+Author: Cade Andrae
+Date: 11/26/24
+Compile Instructions: make mandelmovie
+Test Instructions:
+- ./mandelmovie -x -0.743643 -y 0.131825 -s 4 -W 3840 -H 2160 -m 1000 -n 300 -p <num_processes>
+-  ffmpeg -framerate 30 -i mandel%d.jpg -c:v libx264 -pix_fmt yuv420p -crf 18 -preset slow mandelzoom.mp4
+**************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include "jpegrw.h"
+#include "framequeue.h"
+#include "framestream.h"
+#include "frameencoder.h"
+#include "frametiming.h"
+#include "framemanifest.h"
+#include "framewriter.h"
+#include "framenet.h"
+#include "placement.h"
+#include "gpukernel.h"
+#include "render.h"
+#include "kernel.h"
+#include "iterfile.h"
+
+// Parameters shared by every frame of the movie
+typedef struct movieConfig {
+    double xcenter;
+    double ycenter;
+    double xscale;
+    double zoom_factor;
+    int image_width;
+    int image_height;
+    int max_iterations;                                 // The cap of every frame, or of the deepest one with adaptive_max
+    int adaptive_max;                                   // Grow each frame's cap with the zoom depth
+    const char *outfile_base;
+    const colorPalette *palette;                        // Built for max_iterations
+    const char *palette_file;                           // For building palettes for other caps, NULL for the built-in one
+    int solid_fill;
+    int mirror;                                         // Copy the rows mirrored across the real axis
+    int deep_zoom;                                      // Perturbation engine instead of plain doubles
+    precisionType precision;                            // Double unless -F asks for another or for the planner
+    deepFloat xcenter_deep;                             // Centers with every digit given on the command line
+    deepFloat ycenter_deep;
+    int num_images;
+    int keyframe_interval;                              // 0 renders every frame from scratch
+    int keyframe_tolerance;                             // Largest count spread reused from a keyframe
+    int stream_fd;                                      // Child's pipe to the parent when streaming, else -1
+    int save_counts;                                    // Also write each frame's counts to <base><i>.cnt
+    iterCompression count_compression;
+    imgFormat format;                                   // Output backend for the frames
+    imgJpegOptions jpeg;                                // How JPEG frames are encoded
+    frameTiming *timings;                               // Shared table every child records its frames in
+    frameManifest *manifest;                            // Checkpoint of the stored frames, NULL when streaming
+    int net_fd;                                         // A worker child's connection to the coordinator, else -1
+    int worker_id;                                      // Which child this is
+    int write_depth;                                    // Frame files written at once in the background, 0 to write in place
+    int direct_io;                                      // Bypass the page cache with O_DIRECT
+    frameWriter *writer;                                // A worker's background writes, NULL to write in place
+} movieConfig;
+
+static int frame_max(const movieConfig *cfg, double scale);
+static precisionType frame_precision(const movieConfig *cfg, int width, double scale);
+static int double_holds(const movieConfig *cfg, int width, double scale);
+static precisionType compute_frame(const movieConfig *cfg, renderPool *pool, int *counts, int width, int height,
+                                   double scale, int max, renderStats *stats);
+static void compute_frame_progressive(const movieConfig *cfg, renderPool *pool, int *counts, double scale, int max,
+                                      progressLevelFn level_done, void *context);
+static double *predict_unit_costs(const movieConfig *cfg, int num_threads, int num_units);
+#define KEYFRAME_MAX_OVERSIZE 2.0                       // Keyframes are at most this many times wider than a frame
+#define STREAM_BUFFER_FRAMES 8                          // Frames the parent holds back while streaming out of order
+#define WORKER_FRAMES 2                                 // One frame being computed while the other is encoded
+#define PREDICT_DIVISOR 32                              // The cost predictor renders frames at 1/32 of the size
+#define PROBE_DIVISOR 32                                // The -F auto probe iterates every 32nd pixel of a double frame,
+#define PROBE_MIN_SIZE 16                               // at least 16 by 16 of them,
+#define PROBE_MISMATCH 0.01                             // and switches to perturbation past 1% of them differing
+#define ADAPTIVE_MIN_ITERATIONS 100                     // Cap of the widest frame with adaptive max iterations
+#define WRITE_DEPTH 8                                   // Frame files each worker writes at once by default
+
+#ifdef MANDEL_BUILD                                     // Set by make release and make pgo
+#define BUILD_STRING(name) #name
+#define BUILD_NAME(name) BUILD_STRING(name)
+#define MANDEL_BUILD_NAME BUILD_NAME(MANDEL_BUILD)
+#else
+#define MANDEL_BUILD_NAME "debug"
+#endif
+
+// What each child keeps from frame to frame
+typedef struct movieWorker {
+    renderPool *pool;                                   // Threads sharing each frame
+    imgFramePool *frames;                               // Frame buffers recycled across frames
+    colorPalette *palette;                              // Adaptive max only: palette for palette_max,
+    int palette_max;                                    // rebuilt when a frame has another cap
+    int *counts;                                        // Iteration counts of the frame being rendered
+    frameEncoder *encoder;                              // Stores finished frames while the next one renders
+    gpuRenderer *gpu;                                   // GPU workers only: the device iterating their frames,
+    double *cx;                                         // and the pixel coordinates handed to it
+    double *cy;
+} movieWorker;
+
+// A frame a GPU worker has queued on its device
+typedef struct gpuFrame {
+    int frame;                                          // -1 for none
+    int slot;
+    long long start_ns;
+} gpuFrame;
+
+// What the progressive preview needs to write out each level
+typedef struct previewLevels {
+    renderPool *pool;
+    const colorPalette *palette;
+    const movieConfig *cfg;
+    const char *outfile;                                // The final image, levels are named after it
+    long long start_ns;
+} previewLevels;
+
+static void write_preview_level(void *context, const int *counts, int stride);
+// What a worker needs besides the movie's settings
+typedef struct workerJob {
+    movieConfig cfg;                                    // Its own copy, with worker_id and stream_fd set
+    int num_threads;
+    frameQueue *queue;                                  // Units to pull, NULL for a static block
+    const int *pending;                                 // Unit numbers of the queue entries and blocks
+    int start;                                          // The static block of pending units
+    int end;
+    const char *coordinator;                            // Pull units from here instead
+    const char *fingerprint;
+    int pin;                                            // Pin to cores and allocate on their node
+    int gpu;                                            // The GPU to iterate on, -1 for the CPU
+    int early_out;
+} workerJob;
+
+static const colorPalette *frame_palette(const movieConfig *cfg, movieWorker *worker, int max);
+static void store_counts(const movieConfig *cfg, const char *fname, const int *counts, double scale, int max);
+static void store_frame(void *context, const imgRawImage *img, int i, const char *note);
+static int write_frame_file(const movieConfig *cfg, int i, const unsigned char *data, size_t size, char *outfile,
+                            size_t outfile_size);
+static void frame_written(void *context, int i, const char *path, const unsigned char *data, size_t size,
+                          const char *note, long long write_ns, int error);
+static int store_net_frame(void *context, int frame, const unsigned char *data, size_t size, const frameTiming *timing,
+                           const char *peer);
+static void finish_frame(const movieConfig *cfg, movieWorker *worker, imgRawImage *img, const int *counts, int i, const char *note);
+static void render_frame(const movieConfig *cfg, movieWorker *worker, int i);
+static void render_keyframe_group(const movieConfig *cfg, movieWorker *worker, int group);
+static void render_unit(const movieConfig *cfg, movieWorker *worker, int unit);
+static int unit_done(const movieConfig *cfg, int unit);
+static void manifest_fingerprint(char *buffer, size_t size, const movieConfig *cfg, const char *xcenter_text,
+                                 const char *ycenter_text, int early_out);
+static int check_workers(const pid_t *pids, int num_processes);
+static int coordinate_workers(const movieConfig *cfg, int port, const char *fingerprint, const int *pending, int num_pending,
+                              const frameQueue *queue);
+static void write_stats(const char *path, const movieConfig *cfg);
+static void write_bench_row(const char *fname, const movieConfig *cfg, int num_processes, int num_threads,
+                            const char *kernel, int early_out, schedMode sched_mode, const char *workers,
+                            long long wall_ns);
+static int next_unit(workerJob *job);
+static int gpu_frame(const movieConfig *cfg, int unit);
+static int submit_gpu_frame(const movieConfig *cfg, movieWorker *worker, int i);
+static void finish_gpu_frame(const movieConfig *cfg, movieWorker *worker, const gpuFrame *flight);
+static void run_worker(workerJob *job);
+static void *worker_thread(void *arg);
+static void show_help();
+
+int main(int argc, char *argv[]) {
+    char c;
+    double xcenter = -0.743643;
+    double ycenter = 0.131825;
+    deepFloat xcenter_deep = xcenter;
+    deepFloat ycenter_deep = ycenter;
+    const char *xcenter_text = "-0.743643";             // The centers as given, to tell renders apart on resume
+    const char *ycenter_text = "0.131825";
+    double xscale = 4.0;                                // Start at the default scale
+    double final_scale = 1e-3;                          // Final scale for a deeper zoom
+    int image_width = 3840;                             // 4K width
+    int image_height = 2160;                            // 4K height
+    int max_iterations = 1000;
+    int num_images = 300;                               // Create 300 images for 30 FPS, 10 seconds of video
+    int num_processes = sysconf(_SC_NPROCESSORS_ONLN);  // Default to all available CPU threads
+    char outfile_base[256] = "mandel";
+    int preview_final = 0;                              // Flag for previewing the final image
+    int progressive = 0;                                // Write coarse levels of the preview first
+    int resume = 0;                                     // Only render the frames the manifest doesn't have
+    int coordinator_port = 0;                           // Hand the frames out to workers on other nodes
+    const char *coordinator = NULL;                     // Or be one of those workers
+    int thread_workers = 0;                             // Run the -p workers as threads of this process instead of fork()
+    int pin_workers = 0;                                // Pin each worker to cores of one NUMA node
+    int num_gpus = 0;                                   // Workers that iterate on a GPU instead
+    int blocked_kernels = 1;                            // Escape checks every few iterations, specialized caps
+    int write_depth = WRITE_DEPTH;                      // Frame files written at once in the background
+    int direct_io = 0;                                  // Write them with O_DIRECT
+    schedMode sched_mode = SCHED_DYNAMIC;               // Children pull frames from a shared queue
+    int num_threads = 1;                                // Threads per process working on the same frame
+    kernelType kernel = KERNEL_AUTO;                    // Best SIMD kernel the CPU supports
+    const char *palette_file = NULL;                    // Built-in color scheme unless a palette file is given
+    int early_out = 1;                                  // Skip cardioid/bulb points and cycling orbits
+    int adaptive_max = 0;                               // Same max iterations for every frame
+    int solid_fill = 0;                                 // Mariani-Silver fill of flat rectangles
+    int mirror = 1;                                     // Copy the rows mirrored across the real axis
+    int deep_zoom = 0;                                  // Perturbation engine for scales past double precision
+    precisionType precision = PRECISION_DOUBLE;         // Or float/perturbation per frame with -F auto
+    int keyframe_interval = 0;                          // Render a keyframe every N frames and resample the rest
+    int keyframe_tolerance = 0;                         // Count spread allowed when resampling a keyframe
+    const char *stream_path = NULL;                     // Stream raw RGB frames here (- for stdout) instead of JPEGs
+    const char *video_path = NULL;                      // Or encode them straight into this movie
+    const char *video_codec = "libx264";
+    const char *bench_file = NULL;                      // Append a CSV row of timings here when done
+    const char *stats_path = NULL;                      // Per-frame stats as JSON lines (or CSV) here when done
+    int save_counts = 0;                                // Keep the raw iteration counts for recoloring
+    iterCompression count_compression = ITER_RAW;       // Or delta code and deflate them
+    imgJpegOptions jpeg = IMG_JPEG_DEFAULTS;            // Quality 100, accurate DCT
+    int format = -1;                                    // Output backend, from the -o extension unless -f is given
+
+    while ((c = getopt(argc, argv, "x:y:s:z:W:H:m:o:f:p:n:S:t:k:C:K:T:R:V:c:J:B:L:N:w:F:g:q:AEMYDIZGrXaUdhP")) != -1) {
+        switch (c) {
+            case 'x':
+                xcenter = atof(optarg);
+                xcenter_deep = parseDeepFloat(optarg);
+                xcenter_text = optarg;
+                break;
+            case 'y':
+                ycenter = atof(optarg);
+                ycenter_deep = parseDeepFloat(optarg);
+                ycenter_text = optarg;
+                break;
+            case 's':
+                xscale = atof(optarg);
+                break;
+            case 'z':
+                final_scale = atof(optarg);
+                break;
+            case 'W':
+                image_width = atoi(optarg);
+                break;
+            case 'H':
+                image_height = atoi(optarg);
+                break;
+            case 'm':
+                max_iterations = atoi(optarg);
+                break;
+            case 'o':
+                strncpy(outfile_base, optarg, sizeof(outfile_base) - 1);
+                outfile_base[sizeof(outfile_base) - 1] = '\0';
+                break;
+            case 'f':
+                format = parseImageFormat(optarg);
+                if (format < 0) {
+                    fprintf(stderr, "Error: Unknown output format '%s'.\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                num_processes = atoi(optarg);
+                break;
+            case 'n':
+                num_images = atoi(optarg);
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'k':
+                if (parseKernelType(optarg) < 0) {
+                    fprintf(stderr, "Error: Unknown kernel '%s'.\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                kernel = parseKernelType(optarg);
+                break;
+            case 'C':
+                palette_file = optarg;
+                break;
+            case 'A':
+                adaptive_max = 1;
+                break;
+            case 'E':
+                early_out = 0;
+                break;
+            case 'M':
+                solid_fill = 1;
+                break;
+            case 'Y':
+                mirror = 0;
+                break;
+            case 'D':
+                deep_zoom = 1;
+                break;
+            case 'I':
+                save_counts = 1;
+                break;
+            case 'Z':
+                count_compression = ITER_DELTA_ZLIB;
+                break;
+            case 'J':
+                if (parseJpegOptions(optarg, &jpeg) < 0) {
+                    fprintf(stderr, "Error: Bad JPEG options '%s'.\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'K':
+                keyframe_interval = atoi(optarg);
+                break;
+            case 'T':
+                keyframe_tolerance = atoi(optarg);
+                break;
+            case 'R':
+                stream_path = optarg;
+                break;
+            case 'V':
+                video_path = optarg;
+                break;
+            case 'c':
+                video_codec = optarg;
+                break;
+            case 'B':
+                bench_file = optarg;
+                break;
+            case 'L':
+                stats_path = optarg;
+                break;
+            case 'P':
+                preview_final = 1;
+                break;
+            case 'G':
+                progressive = 1;
+                break;
+            case 'r':
+                resume = 1;
+                break;
+            case 'N':
+                coordinator_port = atoi(optarg);
+                break;
+            case 'w':
+                coordinator = optarg;
+                break;
+            case 'X':
+                thread_workers = 1;
+                break;
+            case 'F':
+                if (parsePrecision(optarg) < 0) {
+                    fprintf(stderr, "Error: Unknown precision '%s'.\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                precision = parsePrecision(optarg);
+                break;
+            case 'a':
+                pin_workers = 1;
+                break;
+            case 'g':
+                num_gpus = atoi(optarg);
+                break;
+            case 'U':
+                blocked_kernels = 0;
+                break;
+            case 'q':
+                write_depth = atoi(optarg);
+                break;
+            case 'd':
+                direct_io = 1;
+                break;
+            case 'S':
+                if (parseSchedMode(optarg) < 0) {
+                    fprintf(stderr, "Error: Unknown scheduler '%s'.\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                sched_mode = parseSchedMode(optarg);
+                break;
+            case 'h':
+                show_help();
+                exit(1);
+                break;
+        }
+    }
+
+    int base_format = imageFormatFromFilename(outfile_base);                                // -o zoom.png means zoom<i>.png frames
+    if (base_format >= 0) {
+        *strrchr(outfile_base, '.') = '\0';
+        if (format < 0) {
+            format = base_format;
+        }
+    }
+    if (format < 0) {
+        format = IMG_FORMAT_JPEG;
+    }
+
+    setBlockedKernels(blocked_kernels);
+    kernel = selectKernel(kernel);                                                          // Pick the instruction set once, before any fork
+    char kernel_name[32];
+    snprintf(kernel_name, sizeof(kernel_name), "%s%s", kernelTypeName(kernel),
+             !blocked_kernels && (kernel == KERNEL_AVX2 || kernel == KERNEL_AVX512) ? "-plain" : "");
+    setEarlyOut(early_out);
+    setSolidFill(solid_fill);
+    setMirror(mirror);
+
+    colorPalette *palette = palette_file ? loadPaletteFile(palette_file, max_iterations)     // One color per iteration count, shared by every frame
+                                         : initMoviePalette(max_iterations);
+    if (palette == NULL) {
+        fprintf(stderr, "Error: Could not load palette '%s'.\n", palette_file ? palette_file : "built-in");
+        exit(EXIT_FAILURE);
+    }
+
+    double yscale = xscale / image_width * image_height;                        	        // Calculate y scale based on x scale (settable) and image sizes in X and Y (settable)
+    double zoom_factor = pow(final_scale / xscale, 1.0 / num_images);
+    if (precision == PRECISION_PERTURB) {
+        deep_zoom = 1;                                                                      // -F perturb is -D by another name
+    }
+    if (!deep_zoom && precision != PRECISION_AUTO &&
+        planPrecision(final_scale / image_width, fmax(fabs(xcenter), fabs(ycenter))) == PRECISION_PERTURB) {
+        fprintf(stderr, "Warning: Final scale %g is past double precision. Use -D for a deep zoom.\n", final_scale);
+    }
+
+    if (deep_zoom && keyframe_interval > 0) {
+        fprintf(stderr, "Error: Keyframe resampling (-K) can't be combined with a deep zoom (-D).\n");
+        exit(EXIT_FAILURE);
+    }
+    if (keyframe_interval > 1 && precision != PRECISION_DOUBLE) {
+        fprintf(stderr, "Error: Keyframe resampling (-K) iterates doubles and can't be combined with -F %s.\n",
+                precisionName(precision));
+        exit(EXIT_FAILURE);
+    }
+    if (keyframe_interval == 1) {
+        keyframe_interval = 0;                                                              // A keyframe per frame is just the normal path
+    }
+    if (keyframe_interval > 0 && pow(zoom_factor, 1 - keyframe_interval) > KEYFRAME_MAX_OVERSIZE) {
+        fprintf(stderr, "Warning: The zoom is too fast for -K %d, keyframes are capped at %gx and the deepest frames "
+                "of each group will be resampled from fewer pixels.\n", keyframe_interval, KEYFRAME_MAX_OVERSIZE);
+    }
+
+    movieConfig cfg = {
+        .xcenter = xcenter,
+        .ycenter = ycenter,
+        .xscale = xscale,
+        .zoom_factor = zoom_factor,
+        .image_width = image_width,
+        .image_height = image_height,
+        .max_iterations = max_iterations,
+        .adaptive_max = adaptive_max,
+        .outfile_base = outfile_base,
+        .palette = palette,
+        .palette_file = palette_file,
+        .solid_fill = solid_fill,
+        .mirror = mirror,
+        .deep_zoom = deep_zoom,
+        .precision = deep_zoom ? PRECISION_PERTURB : precision,
+        .xcenter_deep = xcenter_deep,
+        .ycenter_deep = ycenter_deep,
+        .num_images = num_images,
+        .keyframe_interval = keyframe_interval,
+        .keyframe_tolerance = keyframe_tolerance,
+        .stream_fd = -1,
+        .net_fd = -1,
+        .save_counts = save_counts,
+        .count_compression = count_compression,
+        .format = format,
+        .jpeg = jpeg,
+        .write_depth = write_depth,
+        .direct_io = direct_io,
+    };
+
+    // If preview_final, generate only the last image
+    if (preview_final) {
+        double last_scale = xscale * pow(zoom_factor, num_images - 1);
+
+        char final_outfile[256];
+        size_t max_base_length = sizeof(final_outfile) - strlen("_final.") - strlen(imageFormatExtension(format)) - 1;
+        if (strlen(outfile_base) > max_base_length) {
+            fprintf(stderr, "Error: Base filename too long. Truncating.\n");
+            strncpy(final_outfile, outfile_base, max_base_length);
+            final_outfile[max_base_length] = '\0';
+        } else {
+            strcpy(final_outfile, outfile_base);
+        }
+        strcat(final_outfile, "_final.");
+        strcat(final_outfile, imageFormatExtension(format));
+
+        renderPool *pool = initRenderPool(num_processes * num_threads);                     // No children here, so give the threads every core
+        renderStats stats;
+        imgRawImage *img = initRawImage(image_width, image_height);                         // Create a raw image of the appropriate size.
+        int *counts = malloc(sizeof(int) * image_width * image_height);
+        int last_max = frame_max(&cfg, last_scale);                                         // The deepest frame has the largest cap
+        if (progressive) {
+            previewLevels levels = { pool, palette, &cfg, final_outfile, monotonicNs() };
+            compute_frame_progressive(&cfg, pool, counts, last_scale, last_max, write_preview_level, &levels);
+            stats.pixels_skipped = 0;                                                       // Progressive levels don't solid fill
+        } else {
+            compute_frame(&cfg, pool, counts, image_width, image_height, last_scale, last_max, &stats); // Compute the Mandelbrot image
+        }
+        colorize_counts(pool, img, counts, palette);
+        storeImageFile(img, final_outfile, format, &jpeg);                                  // Save the image in the stated file.
+        if (save_counts) {
+            strcpy(strrchr(final_outfile, '.'), ".cnt");
+            store_counts(&cfg, final_outfile, counts, last_scale, last_max);
+        }
+        free(counts);
+        freeRawImage(img);                                                                  // free the mallocs
+        freeRenderPool(pool);
+        freePalette(palette);
+
+        printf("Generated final preview image: %s\n", final_outfile);
+        if (solid_fill && !progressive) {
+            printf("Solid fill skipped %ld of %ld pixels\n", stats.pixels_skipped, (long)image_width * image_height);
+        }
+        exit(0);
+    }
+
+    if (stream_path != NULL && video_path != NULL) {
+        fprintf(stderr, "Error: Choose one of streaming (-R) and video encoding (-V).\n");
+        exit(EXIT_FAILURE);
+    }
+    if (resume && (stream_path != NULL || video_path != NULL)) {
+        fprintf(stderr, "Error: A streamed movie (-R, -V) can't be resumed (-r), it needs every frame in one run.\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((coordinator_port > 0 || coordinator != NULL) && (stream_path != NULL || video_path != NULL || preview_final)) {
+        fprintf(stderr, "Error: Multi-node rendering (-N, -w) writes image files, it can't stream (-R, -V) or preview (-P).\n");
+        exit(EXIT_FAILURE);
+    }
+    if (coordinator_port > 0 && coordinator != NULL) {
+        fprintf(stderr, "Error: Choose one of coordinating (-N) and working for a coordinator (-w).\n");
+        exit(EXIT_FAILURE);
+    }
+    if (num_gpus < 0 || num_gpus > num_processes) {
+        fprintf(stderr, "Error: -g %d needs between 0 and the %d workers of -p.\n", num_gpus, num_processes);
+        exit(EXIT_FAILURE);
+    }
+    if (write_depth < 0) {
+        fprintf(stderr, "Error: -q needs 0 or more frames.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (num_gpus > 0 && sched_mode == SCHED_STATIC) {
+        fprintf(stderr, "Warning: GPU workers are faster than the others, switching the static scheduler to dynamic.\n");
+        sched_mode = SCHED_DYNAMIC;
+    }
+
+    int stream_out = -1;
+    pid_t video_pid = -1;
+    if (stream_path != NULL || video_path != NULL) {
+        if (video_path != NULL) {
+            stream_out = startVideoEncoder(video_path, video_codec, image_width, image_height, 30, &video_pid);
+        } else if (strcmp(stream_path, "-") == 0) {
+            stream_out = dup(STDOUT_FILENO);                                                // Frames get stdout to themselves,
+            dup2(STDERR_FILENO, STDOUT_FILENO);                                             // progress messages move to stderr
+        } else {
+            stream_out = open(stream_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);             // Opening a FIFO waits for its reader
+        }
+        if (stream_out < 0) {
+            perror("mandelmovie: stream output");
+            exit(EXIT_FAILURE);
+        }
+        signal(SIGPIPE, SIG_IGN);                                                           // A reader going away is reported as a write error
+        if (sched_mode == SCHED_LPT) {
+            fprintf(stderr, "Warning: Streaming writes frames in order, switching the lpt scheduler to dynamic.\n");
+            sched_mode = SCHED_DYNAMIC;
+        }
+    }
+
+    printf("mandelmovie: x=%lf y=%lf xscale=%lf yscale=%lf final=%g max=%d images=%d processes=%d threads=%d scheduler=%s kernel=%s%s\n",
+           xcenter, ycenter, xscale, yscale, final_scale, max_iterations, num_images, num_processes, num_threads,
+           schedModeName(sched_mode), kernel_name, deep_zoom ? " deep" : "");
+
+    if (adaptive_max) {
+        printf("mandelmovie: adaptive max iterations from %d up to %d\n", frame_max(&cfg, xscale), max_iterations);
+    }
+    if (thread_workers || pin_workers) {
+        printf("mandelmovie: workers are %s%s\n", thread_workers ? "threads" : "processes",
+               pin_workers ? ", pinned to NUMA nodes" : "");
+    }
+    if (num_gpus > 0) {
+        printf("mandelmovie: %d of the %d workers iterate on GPUs\n", num_gpus, num_processes);
+    }
+    if (keyframe_interval > 0) {
+        printf("mandelmovie: keyframe every %d frames, tolerance %d\n", keyframe_interval, keyframe_tolerance);
+    }
+
+    // A unit of work is a frame, or a keyframe and the frames resampled from it
+    int num_units = keyframe_interval > 0 ? (num_images + keyframe_interval - 1) / keyframe_interval : num_images;
+
+    cfg.timings = initFrameTimings(num_images);                                             // Shared with the children across fork()
+    if (cfg.timings == NULL) {
+        perror("mandelmovie: frame timings");
+        exit(EXIT_FAILURE);
+    }
+
+    char fingerprint[512];                                                                  // Ties manifests and workers to these settings
+    manifest_fingerprint(fingerprint, sizeof(fingerprint), &cfg, xcenter_text, ycenter_text, early_out);
+    char manifest_path[sizeof(outfile_base) + 16];
+    if (stream_out < 0 && coordinator == NULL) {                                            // Workers' frames are stored by the coordinator
+        snprintf(manifest_path, sizeof(manifest_path), "%s.manifest", outfile_base);
+        cfg.manifest = initFrameManifest(manifest_path, fingerprint, num_images, resume);   // Frames are appended as they are stored
+        if (cfg.manifest == NULL) {
+            perror("mandelmovie: manifest");
+            exit(EXIT_FAILURE);
+        }
+        if (cfg.manifest->stale) {
+            fprintf(stderr, "Warning: %s is from a render with other settings, rendering every frame.\n", manifest_path);
+        } else if (resume) {
+            printf("mandelmovie: resuming, %d of %d frames already done\n", cfg.manifest->resumed, num_images);
+        }
+    }
+
+    int *pending = malloc(sizeof(int) * (num_units > 0 ? num_units : 1));                  // The units still to render, in order
+    int num_pending = 0;
+    for (int u = 0; u < num_units; ++u) {
+        if (!unit_done(&cfg, u)) {
+            pending[num_pending++] = u;
+        }
+    }
+
+    double *unit_costs = NULL;
+    if (sched_mode == SCHED_LPT && coordinator == NULL) {
+        unit_costs = predict_unit_costs(&cfg, num_processes * num_threads, num_units);      // Tiny pre-render of every frame
+        for (int k = 0; k < num_pending; ++k) {
+            unit_costs[k] = unit_costs[pending[k]];                                         // Only the pending ones are queued
+        }
+    }
+    frameQueue *queue = NULL;
+    if (sched_mode != SCHED_STATIC && coordinator == NULL) {
+        queue = initFrameQueue(num_pending, sched_mode, unit_costs);                        // Also shared across fork()
+        if (queue == NULL) {
+            perror("mandelmovie: frame queue");
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(unit_costs);
+
+    long long start_ns = monotonicNs();
+    int num_children = num_processes;
+    int failed = 0;
+    if (coordinator_port > 0) {
+        failed = coordinate_workers(&cfg, coordinator_port, fingerprint, pending, num_pending, queue);
+        num_children = 0;                                                                   // The workers do the rendering
+    }
+
+    fflush(stdout);                                                                         // Don't let the children inherit unflushed output
+    pid_t pids[num_processes];
+    pthread_t threads[num_processes];
+    int stream_fds[num_processes];                                                          // Parent's read end of each child's frame pipe
+    int units_per_process = num_pending / num_processes;
+    int remainder_units = num_pending % num_processes;                                      // For uneven division of work
+    workerJob jobs[num_processes];
+    if (thread_workers) {
+        setvbuf(stdout, NULL, _IOLBF, 0);                                                   // Whole lines, so the workers' progress doesn't interleave
+    }
+
+    for (int p = 0; p < num_children; ++p) {
+        int frame_pipe[2] = { -1, -1 };
+        if (stream_out >= 0 && pipe(frame_pipe) < 0) {
+            perror("mandelmovie: pipe");
+            exit(EXIT_FAILURE);
+        }
+        jobs[p] = (workerJob){
+            .cfg = cfg,
+            .num_threads = num_threads,
+            .queue = queue,
+            .pending = pending,
+            .start = p * units_per_process,
+            .end = (p + 1) * units_per_process + (p == num_processes - 1 ? remainder_units : 0),   // Last process gets extra images
+            .coordinator = coordinator,
+            .fingerprint = fingerprint,
+            .pin = pin_workers,
+            .gpu = p < num_gpus ? p : -1,                                                   // The first workers take a GPU each
+            .early_out = early_out,
+        };
+        jobs[p].cfg.worker_id = p;
+        jobs[p].cfg.stream_fd = frame_pipe[1];
+        if (thread_workers) {
+            if (pthread_create(&threads[p], NULL, worker_thread, &jobs[p]) != 0) {           // Shares the palette and the address space
+                fprintf(stderr, "Error: Could not start worker thread %d.\n", p);
+                exit(EXIT_FAILURE);
+            }
+            if (stream_out >= 0) {
+                stream_fds[p] = frame_pipe[0];                                              // The worker closes its end when it is done
+            }
+            continue;
+        }
+        if ((pids[p] = fork()) == 0) {                                                      // Child process
+            setvbuf(stdout, NULL, _IOLBF, 0);                                               // Whole lines, so the children's progress doesn't interleave
+            if (stream_out >= 0) {
+                close(stream_out);
+                close(frame_pipe[0]);
+                for (int q = 0; q < p; ++q) {
+                    close(stream_fds[q]);
+                }
+            }
+            run_worker(&jobs[p]);
+            exit(0);
+        }
+        if (stream_out >= 0) {
+            close(frame_pipe[1]);
+            stream_fds[p] = frame_pipe[0];
+        }
+    }
+
+    if (stream_out >= 0) {
+        int written = runFrameStream(stream_out, stream_fds, num_processes, num_images, STREAM_BUFFER_FRAMES);
+        for (int p = 0; p < num_processes; ++p) {
+            close(stream_fds[p]);                                                           // Unblocks any child still writing
+        }
+        if (video_pid < 0) {
+            close(stream_out);
+            fprintf(stderr, "Streamed %d of %d frames (%dx%d rgb24).\n", written, num_images, image_width, image_height);
+        } else if (finishVideoEncoder(stream_out, video_pid) != 0 || written < num_images) {
+            fprintf(stderr, "Error: Encoding %s failed after %d of %d frames.\n", video_path, written, num_images);
+            exit(EXIT_FAILURE);
+        } else {
+            printf("Encoded %d frames into %s (%s).\n", written, video_path, video_codec);
+        }
+    }
+
+    // Parent process waits for all children to complete
+    if (thread_workers) {
+        for (int p = 0; p < num_children; ++p) {
+            pthread_join(threads[p], NULL);                                                 // A worker that fails takes the process down
+        }
+    } else {
+        failed += check_workers(pids, num_children);
+    }
+    free(pending);
+    if (sched_mode == SCHED_LPT) {
+        long long predicted = 0, actual = 0;
+        for (int i = 0; i < num_images; ++i) {
+            predicted += cfg.timings[i].predicted;
+            actual += cfg.timings[i].iterations;
+        }
+        printf("Cost predictor: %lld iterations predicted, %lld actual (%+.1f%%)\n", predicted, actual,
+               actual > 0 ? 100.0 * (predicted - actual) / actual : 0.0);
+    }
+    if (stats_path != NULL) {
+        write_stats(stats_path, &cfg);
+    }
+    if (bench_file != NULL) {
+        char workers[32];
+        snprintf(workers, sizeof(workers), "%s%s", thread_workers ? (pin_workers ? "threads+pin" : "threads")
+                                                                  : (pin_workers ? "fork+pin" : "fork"),
+                 num_gpus > 0 ? "+gpu" : "");
+        write_bench_row(bench_file, &cfg, num_processes, num_threads, kernel_name, early_out, sched_mode,
+                        workers, monotonicNs() - start_ns);
+    }
+    freeFrameTimings(cfg.timings, num_images);
+    if (queue != NULL) {
+        freeFrameQueue(queue);
+    }
+    freePalette(palette);
+    if (stream_out >= 0) {
+        return failed ? EXIT_FAILURE : 0;
+    }
+    if (coordinator != NULL) {
+        if (failed) {
+            exit(EXIT_FAILURE);
+        }
+        printf("All units for %s rendered.\n", coordinator);
+        return 0;
+    }
+    int missing = countMissingFrames(cfg.manifest);
+    freeFrameManifest(cfg.manifest);
+    if (missing > 0) {
+        fprintf(stderr, "Error: %d of %d frames are missing. Run again with -r to render only those.\n", missing, num_images);
+        exit(EXIT_FAILURE);
+    }
+    if (failed) {
+        exit(EXIT_FAILURE);                                                                 // Every frame is there, but not every child finished cleanly
+    }
+    printf("All images generated. Use ffmpeg to create the movie:\n");
+    if (format == IMG_FORMAT_RAW) {
+        printf("ffmpeg -f image2 -c:v rawvideo -pix_fmt rgb24 -s %dx%d -framerate 30 -i %s%%d.rgb -pix_fmt yuv420p mandelzoom.mp4\n",
+               image_width, image_height, outfile_base);
+    } else {
+        printf("ffmpeg -framerate 30 -i %s%%d.%s -pix_fmt yuv420p mandelzoom.mp4\n", outfile_base, imageFormatExtension(format));
+    }
+    return 0;
+}
+
+/*
+The iteration cap of a frame at the given scale. With adaptive max it grows
+linearly with the zoom depth in decades - logarithmically in the scale - from
+ADAPTIVE_MIN_ITERATIONS at the start scale to max_iterations at the final one.
+*/
+int frame_max(const movieConfig *cfg, double scale) {
+    if (!cfg->adaptive_max || cfg->max_iterations <= ADAPTIVE_MIN_ITERATIONS) {
+        return cfg->max_iterations;
+    }
+    double total_depth = -(cfg->num_images - 1) * log(cfg->zoom_factor);                 // Natural log of start over final scale
+    double depth = log(cfg->xscale / scale);
+    double t = total_depth > 0 ? fmin(fmax(depth / total_depth, 0), 1) : 1;
+    return ADAPTIVE_MIN_ITERATIONS + (int)lround(t * (cfg->max_iterations - ADAPTIVE_MIN_ITERATIONS));
+}
+
+/*
+The palette for a frame capped at max: the shared one, or with adaptive max one
+the worker keeps until a frame with another cap comes along
+*/
+const colorPalette *frame_palette(const movieConfig *cfg, movieWorker *worker, int max) {
+    if (max == cfg->max_iterations) {
+        return cfg->palette;
+    }
+    if (worker->palette == NULL || worker->palette_max != max) {
+        if (worker->palette != NULL) {
+            freePalette(worker->palette);
+        }
+        worker->palette = cfg->palette_file ? loadPaletteFile(cfg->palette_file, max) : initMoviePalette(max);
+        worker->palette_max = max;
+        if (worker->palette == NULL) {
+            fprintf(stderr, "Error: Could not build a palette for %d iterations.\n", max);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return worker->palette;
+}
+
+/*
+The arithmetic a frame at the given scale is rendered with, width pixels across: with -F auto the
+planner's pick from the spacing of the pixels and the size of the coordinates, except that a frame
+it leaves to doubles goes to perturbation when a probe of the frame shows doubles going wrong
+*/
+precisionType frame_precision(const movieConfig *cfg, int width, double scale) {
+    if (cfg->precision != PRECISION_AUTO) {
+        return cfg->precision;
+    }
+    precisionType precision = planPrecision(scale / width, fmax(fabs(cfg->xcenter), fabs(cfg->ycenter)) + scale / 2);
+    if (precision == PRECISION_DOUBLE && !double_holds(cfg, width, scale)) {
+        return PRECISION_PERTURB;
+    }
+    return precision;
+}
+
+/*
+Whether plain doubles still get a frame right: iterate a coarse grid of its pixels with doubles and
+with perturbation from the center's deep orbit, which keeps its accuracy where the rounding of
+double orbits is amplified (spiral centers at high caps), and compare the counts
+*/
+int double_holds(const movieConfig *cfg, int width, double scale) {
+    int max = frame_max(cfg, scale);
+    int probe_width = width / PROBE_DIVISOR > PROBE_MIN_SIZE ? width / PROBE_DIVISOR : PROBE_MIN_SIZE;
+    int probe_height = (long)probe_width * cfg->image_height / cfg->image_width;
+    probe_height = probe_height > PROBE_MIN_SIZE ? probe_height : PROBE_MIN_SIZE;
+
+    refOrbit *ref = initRefOrbit(cfg->xcenter_deep, cfg->ycenter_deep, max);
+    double *cx = malloc(sizeof(double) * probe_width);
+    double *cy = malloc(sizeof(double) * probe_height);
+    double *row_y = malloc(sizeof(double) * probe_width);
+    int *iters = malloc(sizeof(int) * probe_width);
+    if (ref == NULL || cx == NULL || cy == NULL || row_y == NULL || iters == NULL) {
+        fprintf(stderr, "Error: Out of memory for the precision probe.\n");
+        exit(EXIT_FAILURE);
+    }
+    compute_coords(probe_width, probe_height, cfg->xcenter - scale / 2, cfg->xcenter + scale / 2,
+                   cfg->ycenter - scale / 2, cfg->ycenter + scale / 2, cx, cy);      // The points compute_counts would iterate
+    long differ = 0;
+    for (int j = 0; j < probe_height; ++j) {
+        for (int i = 0; i < probe_width; ++i) {
+            row_y[i] = cy[j];
+        }
+        iterate_points(cx, row_y, probe_width, max, iters);
+        double dcy = -scale / 2 + j * scale / probe_height;                           // As compute_counts_perturbed offsets them,
+        if (cfg->ycenter - scale / 2 < 0 && cfg->ycenter + scale / 2 > 0) {
+            dcy = cy[j] - cfg->ycenter;                                             // or onto the rows snapped to the axis
+        }
+        for (int i = 0; i < probe_width; ++i) {
+            double dcx = -scale / 2 + i * scale / probe_width;
+            differ += iterations_perturbed(ref, dcx, dcy, max) != iters[i];
+        }
+    }
+
+    free(iters);
+    free(row_y);
+    free(cy);
+    free(cx);
+    freeRefOrbit(ref);
+    return differ <= PROBE_MISMATCH * probe_width * probe_height;
+}
+
+/*
+Compute the iteration counts of one frame of the zoom at the given scale around the movie's center.
+Returns the precision it was computed with.
+*/
+precisionType compute_frame(const movieConfig *cfg, renderPool *pool, int *counts, int width, int height,
+                            double scale, int max, renderStats *stats) {
+    precisionType precision = frame_precision(cfg, width, scale);
+    if (precision == PRECISION_PERTURB) {
+        refOrbit *ref = initRefOrbit(cfg->xcenter_deep, cfg->ycenter_deep, max);   // One reference orbit for the whole frame
+        if (ref == NULL) {
+            fprintf(stderr, "Error: Out of memory for the reference orbit.\n");
+            exit(EXIT_FAILURE);
+        }
+        compute_counts_perturbed(pool, counts, width, height, ref, scale, scale, max, stats);
+        freeRefOrbit(ref);
+        return precision;
+    }
+
+    double ymin = cfg->ycenter - scale / 2;
+    double ymax = cfg->ycenter + scale / 2;
+    double xmin = cfg->xcenter - scale / 2;
+    double xmax = cfg->xcenter + scale / 2;
+    if (precision == PRECISION_FLOAT) {
+        compute_counts_float(pool, counts, width, height, xmin, xmax, ymin, ymax, max, stats);
+    } else {
+        compute_counts(pool, counts, width, height, xmin, xmax, ymin, ymax, max, stats);
+    }
+    return precision;
+}
+
+/*
+compute_frame filled in progressively, calling level_done after each level of the full size frame
+*/
+void compute_frame_progressive(const movieConfig *cfg, renderPool *pool, int *counts, double scale, int max,
+                               progressLevelFn level_done, void *context) {
+    int width = cfg->image_width;
+    int height = cfg->image_height;
+    if (frame_precision(cfg, width, scale) == PRECISION_PERTURB) {                  // The levels have no float path
+        refOrbit *ref = initRefOrbit(cfg->xcenter_deep, cfg->ycenter_deep, max);
+        if (ref == NULL) {
+            fprintf(stderr, "Error: Out of memory for the reference orbit.\n");
+            exit(EXIT_FAILURE);
+        }
+        compute_counts_progressive(pool, counts, width, height, -scale / 2, scale / 2, -scale / 2, scale / 2,
+                                   ref, max, level_done, context);
+        freeRefOrbit(ref);
+        return;
+    }
+
+    compute_counts_progressive(pool, counts, width, height, cfg->xcenter - scale / 2, cfg->xcenter + scale / 2,
+                               cfg->ycenter - scale / 2, cfg->ycenter + scale / 2, NULL, max, level_done, context);
+}
+
+/*
+Write a finished level of the progressive preview as <final>_1of<N>.<ext>, N being the share
+of pixels the level iterated. The full resolution level is stored like any preview.
+*/
+void write_preview_level(void *context, const int *counts, int stride) {
+    previewLevels *levels = context;
+    if (stride == 1) {
+        return;
+    }
+
+    char levelfile[512];
+    const char *dot = strrchr(levels->outfile, '.');
+    snprintf(levelfile, sizeof(levelfile), "%.*s_1of%d%s", (int)(dot - levels->outfile), levels->outfile,
+             stride * stride, dot);                    // The final name always has an extension
+
+    const movieConfig *cfg = levels->cfg;
+    imgRawImage *img = initRawImage((cfg->image_width + stride - 1) / stride, (cfg->image_height + stride - 1) / stride);
+    colorize_level(levels->pool, img, counts, cfg->image_width, stride, levels->palette);
+    storeImageFile(img, levelfile, cfg->format, &cfg->jpeg);
+    freeRawImage(img);
+
+    printf("Generated preview level: %s after %.1f ms\n", levelfile, (monotonicNs() - levels->start_ns) / 1e6);
+    fflush(stdout);
+}
+
+/*
+Estimate the cost of every unit of work by rendering each frame at 1/PREDICT_DIVISOR
+of its size and scaling its total iteration count up to the full frame. Records the
+prediction of every frame in the timing table and returns a malloc'ed cost per unit.
+*/
+double *predict_unit_costs(const movieConfig *cfg, int num_threads, int num_units) {
+    int width = cfg->image_width / PREDICT_DIVISOR > 4 ? cfg->image_width / PREDICT_DIVISOR : 4;
+    int height = cfg->image_height / PREDICT_DIVISOR > 4 ? cfg->image_height / PREDICT_DIVISOR : 4;
+    double upscale = (double)cfg->image_width * cfg->image_height / (width * height);
+
+    double *costs = calloc(num_units, sizeof(double));
+    int *counts = malloc(sizeof(int) * width * height);
+    renderPool *pool = initRenderPool(num_threads);                                       // Gone again before the children fork
+    if (costs == NULL || counts == NULL) {
+        fprintf(stderr, "Error: Out of memory for the cost predictor.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    long long start_ns = monotonicNs();
+    for (int i = 0; i < cfg->num_images; ++i) {
+        double scale = cfg->xscale * pow(cfg->zoom_factor, i);
+        compute_frame(cfg, pool, counts, width, height, scale, frame_max(cfg, scale), NULL);
+        long long iterations = 0;
+        for (int k = 0; k < width * height; ++k) {
+            iterations += counts[k];
+        }
+        cfg->timings[i].predicted = (long long)(iterations * upscale);
+        costs[cfg->keyframe_interval > 0 ? i / cfg->keyframe_interval : i] += iterations * upscale;
+    }
+    printf("Cost predictor: %d frames at %dx%d in %.3f s\n", cfg->num_images, width, height,
+           (monotonicNs() - start_ns) / 1e9);
+
+    freeRenderPool(pool);
+    free(counts);
+    return costs;
+}
+
+/*
+Save the counts of a frame rendered at the given scale for recoloring
+*/
+void store_counts(const movieConfig *cfg, const char *fname, const int *counts, double scale, int max) {
+    iterFrameInfo info = {
+        .xcenter = cfg->xcenter,
+        .ycenter = cfg->ycenter,
+        .xscale = scale,
+        .yscale = scale,
+        .width = cfg->image_width,
+        .height = cfg->image_height,
+        .max = max,
+    };
+    if (storeIterFile(fname, counts, &info, cfg->count_compression) != 0) {
+        fprintf(stderr, "Error: Could not write %s.\n", fname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+Save the counts of finished frame i as <base><i>.cnt when they are kept, then
+hand the image to the encoder thread, which owns it from here on
+*/
+void finish_frame(const movieConfig *cfg, movieWorker *worker, imgRawImage *img, const int *counts, int i, const char *note) {
+    long long iterations = 0;
+    long max_pixels = 0;
+    for (long k = 0; k < (long)cfg->image_width * cfg->image_height; ++k) {
+        iterations += counts[k];
+        max_pixels += counts[k] == cfg->timings[i].max;
+    }
+    cfg->timings[i].iterations = iterations;
+    cfg->timings[i].max_pixels = max_pixels;
+
+    if (cfg->save_counts) {
+        char countfile[256];
+        if (snprintf(countfile, sizeof(countfile), "%s%d.cnt", cfg->outfile_base, i) >= sizeof(countfile)) {
+            fprintf(stderr, "Error: Output filename too long or truncated.\n");
+            exit(EXIT_FAILURE);
+        }
+        store_counts(cfg, countfile, counts, cfg->xscale * pow(cfg->zoom_factor, i),    // The counts buffer is reused right away
+                     cfg->timings[i].max);
+    }
+    submitFrame(worker->encoder, img, i, note);
+}
+
+/*
+Store finished frame i as <base><i>.<ext> in the output format, or send it to the parent when streaming.
+Runs on the encoder thread.
+*/
+void store_frame(void *context, const imgRawImage *img, int i, const char *note) {
+    const movieConfig *cfg = context;
+    long long start_ns = monotonicNs();
+
+    if (cfg->stream_fd >= 0) {
+        if (sendStreamFrame(cfg->stream_fd, i, img) != 0) {
+            fprintf(stderr, "Error: Could not stream frame %d.\n", i);
+            exit(EXIT_FAILURE);
+        }
+        cfg->timings[i].write_ns = monotonicNs() - start_ns;                            // Includes waiting for the parent to take it
+        printf("Generated: frame %d%s\n", i, note);
+        return;
+    }
+
+    unsigned char *data;
+    size_t size;
+    if (encodeImage(img, cfg->format, &cfg->jpeg, &data, &size) != 0) {
+        fprintf(stderr, "Error: Could not encode frame %d.\n", i);
+        exit(EXIT_FAILURE);
+    }
+    long long encoded_ns = monotonicNs();
+    if (cfg->net_fd >= 0) {
+        cfg->timings[i].encode_ns = encoded_ns - start_ns;
+        if (sendNetFrame(cfg->net_fd, i, &cfg->timings[i], data, size) != 0) {            // The coordinator stores it
+            fprintf(stderr, "Error: Could not send frame %d to the coordinator.\n", i);
+            exit(EXIT_FAILURE);
+        }
+        free(data);
+        cfg->timings[i].write_ns = monotonicNs() - encoded_ns;
+        printf("Sent: frame %d%s\n", i, note);
+        return;
+    }
+
+    char outfile[256];
+    cfg->timings[i].encode_ns = encoded_ns - start_ns;
+    if (cfg->writer != NULL) {
+        if (snprintf(outfile, sizeof(outfile), "%s%d.%s", cfg->outfile_base, i, imageFormatExtension(cfg->format)) >= sizeof(outfile)) {
+            fprintf(stderr, "Error: Output filename too long or truncated.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (queueFrameWrite(cfg->writer, outfile, i, data, size, note) != 0) {          // frame_written() finishes it
+            fprintf(stderr, "Error: Out of memory for the write of %s.\n", outfile);
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+    if (write_frame_file(cfg, i, data, size, outfile, sizeof(outfile)) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    free(data);
+    cfg->timings[i].write_ns = monotonicNs() - encoded_ns;
+    printf("Generated: %s%s\n", outfile, note);
+}
+
+/*
+Checkpoint frame i once its background write is done, see store_frame()
+*/
+void frame_written(void *context, int i, const char *path, const unsigned char *data, size_t size,
+                   const char *note, long long write_ns, int error) {
+    const movieConfig *cfg = context;
+    if (error) {
+        fprintf(stderr, "Error: Could not write %s: %s.\n", path, strerror(error));
+        exit(EXIT_FAILURE);
+    }
+    if (recordManifestFrame(cfg->manifest, i, path, data, size) != 0) {                 // Only a complete file gets checkpointed
+        fprintf(stderr, "Error: Could not record frame %d in the manifest.\n", i);
+        exit(EXIT_FAILURE);
+    }
+    cfg->timings[i].write_ns = write_ns;                                                // From queueing to the file being closed
+    printf("Generated: %s%s\n", path, note);
+}
+
+/*
+Write encoded frame i to <base><i>.<ext> and checkpoint it in the manifest. Returns 0 on success,
+with the name in outfile.
+*/
+int write_frame_file(const movieConfig *cfg, int i, const unsigned char *data, size_t size, char *outfile,
+                     size_t outfile_size) {
+    if (snprintf(outfile, outfile_size, "%s%d.%s", cfg->outfile_base, i, imageFormatExtension(cfg->format)) >= outfile_size) {
+        fprintf(stderr, "Error: Output filename too long or truncated.\n");
+        return -1;
+    }
+    if (storeEncodedImage(outfile, data, size) != 0) {                                    // Save the image in the stated file.
+        fprintf(stderr, "Error: Could not write %s.\n", outfile);
+        return -1;
+    }
+    if (recordManifestFrame(cfg->manifest, i, outfile, data, size) != 0) {                 // Only a complete file gets checkpointed
+        fprintf(stderr, "Error: Could not record frame %d in the manifest.\n", i);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+Store a frame a worker sent to the coordinator, with the worker's timing of it for -L and -B
+*/
+int store_net_frame(void *context, int frame, const unsigned char *data, size_t size, const frameTiming *timing,
+                    const char *peer) {
+    const movieConfig *cfg = context;
+    long long start_ns = monotonicNs();
+    char outfile[256];
+    if (write_frame_file(cfg, frame, data, size, outfile, sizeof(outfile)) != 0) {
+        return -1;
+    }
+    long long predicted = cfg->timings[frame].predicted;                                    // The coordinator's own prediction
+    cfg->timings[frame] = *timing;
+    cfg->timings[frame].predicted = predicted;
+    cfg->timings[frame].write_ns = monotonicNs() - start_ns;
+    printf("Generated: %s (from %s)\n", outfile, peer);
+    return 0;
+}
+
+/*
+Run the coordinator: hand the pending units out to the workers that connect on port, in the
+scheduler's order, and store the frames they send. Returns 1 if it failed, else 0.
+*/
+int coordinate_workers(const movieConfig *cfg, int port, const char *fingerprint, const int *pending, int num_pending,
+                       const frameQueue *queue) {
+    int listen_fd = listenFrameCoordinator(port);
+    if (listen_fd < 0) {
+        perror("mandelmovie: coordinator");
+        exit(EXIT_FAILURE);
+    }
+    int *order = malloc(sizeof(int) * (num_pending > 0 ? num_pending : 1));
+    for (int k = 0; k < num_pending; ++k) {
+        order[k] = queue != NULL ? pending[queue->order[k]] : pending[k];                 // lpt puts the costliest first
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);                                                       // A long running service, keep its log in order
+    printf("mandelmovie: coordinating %d units on port %d\n", num_pending, port);
+    int result = runFrameCoordinator(listen_fd, fingerprint, order, num_pending,
+                                     cfg->keyframe_interval > 0 ? cfg->keyframe_interval : 1, cfg->num_images,
+                                     store_net_frame, (void *)cfg);
+    if (result != 0) {
+        fprintf(stderr, "Error: The coordinator failed.\n");
+    }
+    free(order);
+    close(listen_fd);
+    return result != 0;
+}
+
+/*
+Render frame number i of the zoom and store it
+*/
+void render_frame(const movieConfig *cfg, movieWorker *worker, int i) {
+    double scale = cfg->xscale * pow(cfg->zoom_factor, i);
+    char note[64] = "";
+
+    renderStats stats;
+    imgRawImage *img = acquireFrame(worker->frames);                                      // Reuse this child's frame buffer
+    long long start_ns = monotonicNs();
+    int max = frame_max(cfg, scale);
+    cfg->timings[i].max = max;
+    precisionType precision = compute_frame(cfg, worker->pool, worker->counts, cfg->image_width, cfg->image_height,
+                                            scale, max, &stats);                            // Iterate the frame, then color it
+    colorize_counts(worker->pool, img, worker->counts, frame_palette(cfg, worker, max));
+    cfg->timings[i].compute_ns = monotonicNs() - start_ns;
+    cfg->timings[i].worker = cfg->worker_id;
+    cfg->timings[i].precision = precision;
+    if (cfg->solid_fill) {
+        snprintf(note, sizeof(note), " (solid fill skipped %ld pixels)", stats.pixels_skipped);
+    }
+    if (cfg->precision == PRECISION_AUTO) {
+        snprintf(note + strlen(note), sizeof(note) - strlen(note), " (%s)", precisionName(precision));
+    }
+    finish_frame(cfg, worker, img, worker->counts, i, note);
+}
+
+/*
+The life of one worker, as a forked child or as a thread: set up its threads and buffers, pinned
+to its cores and allocated on their node with job->pin, then render units until there are none left
+*/
+void run_worker(workerJob *job) {
+    movieConfig *cfg = &job->cfg;
+    int width = cfg->image_width;
+    int height = cfg->image_height;
+    int cpus[job->num_threads];
+    if (job->pin) {
+        int node = placeWorker(cfg->worker_id, job->num_threads, cpus);
+        if (node < 0 || pinThread(cpus, job->num_threads) != 0 || preferNode(node) != 0) {     // Before anything is allocated
+            fprintf(stderr, "Warning: Could not place worker %d, it runs unpinned.\n", cfg->worker_id);
+            job->pin = 0;
+        }
+    }
+
+    movieWorker worker = {
+        .pool = initRenderPool(job->num_threads),                                           // Threads don't survive fork(), so each child starts its own
+        .frames = initFramePool(width, height, WORKER_FRAMES),                              // Buffers reused for every frame this child renders
+        .counts = malloc(sizeof(int) * width * height),
+    };
+    if (worker.frames == NULL || worker.counts == NULL) {
+        fprintf(stderr, "Error: Could not allocate frame buffers.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (job->pin) {
+        memset(worker.counts, 0, sizeof(int) * width * height);                             // Fault the pages in on this node
+    }
+    worker.encoder = initFrameEncoder(worker.frames, store_frame, cfg);                     // Runs on any of the worker's cores
+    if (worker.encoder == NULL) {
+        fprintf(stderr, "Error: Could not start the encoder thread.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (job->pin) {
+        pinRenderPool(worker.pool, cpus);                                                   // A core each for the render threads
+    }
+    if (job->gpu >= 0) {
+        char error[256];
+        worker.gpu = initGpuRenderer(job->gpu, width, height, job->early_out, error, sizeof(error));
+        worker.cx = malloc(sizeof(double) * width);
+        worker.cy = malloc(sizeof(double) * height);
+        if (worker.gpu == NULL) {
+            fprintf(stderr, "Warning: Worker %d iterates on the CPU, %s.\n", cfg->worker_id, error);
+        } else {
+            printf("Worker %d: iterating on %s\n", cfg->worker_id, gpuDeviceName(worker.gpu));
+        }
+    }
+
+    if (job->coordinator != NULL) {
+        cfg->net_fd = connectFrameCoordinator(job->coordinator, job->fingerprint);         // Every worker is a worker of its own
+        if (cfg->net_fd < 0) {
+            perror("mandelmovie: coordinator");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (cfg->write_depth > 0 && cfg->stream_fd < 0 && cfg->net_fd < 0) {
+        cfg->writer = initFrameWriter(cfg->write_depth, cfg->direct_io, frame_written, cfg);
+        if (cfg->writer == NULL) {
+            fprintf(stderr, "Error: Could not start the frame writer.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (cfg->worker_id == 0) {
+            printf("mandelmovie: writing up to %d frames at once per worker (%s%s)\n", cfg->write_depth,
+                   frameWriterBackend(cfg->writer), cfg->direct_io ? ", O_DIRECT" : "");
+        }
+    }
+    gpuFrame flight = { .frame = -1 };
+    int unit;
+    while ((unit = next_unit(job)) >= 0) {
+        long long start_ns = monotonicNs();
+        int slot = worker.gpu != NULL && gpu_frame(cfg, unit) ? submit_gpu_frame(cfg, &worker, unit) : -1;
+        if (slot < 0 && worker.gpu != NULL && gpu_frame(cfg, unit)) {
+            fprintf(stderr, "Warning: Could not queue frame %d on %s, worker %d iterates on the CPU from here on.\n",
+                    unit, gpuDeviceName(worker.gpu), cfg->worker_id);
+            if (flight.frame >= 0) {
+                finish_gpu_frame(cfg, &worker, &flight);
+                flight.frame = -1;
+            }
+            freeGpuRenderer(worker.gpu);
+            worker.gpu = NULL;
+        }
+        if (slot < 0) {
+            render_unit(cfg, &worker, unit);
+            continue;
+        }
+        if (flight.frame >= 0) {
+            finish_gpu_frame(cfg, &worker, &flight);                                        // The device works on the next one meanwhile
+        }
+        flight = (gpuFrame){ unit, slot, start_ns };
+    }
+    if (flight.frame >= 0) {
+        finish_gpu_frame(cfg, &worker, &flight);
+    }
+    freeFrameEncoder(worker.encoder);                                                       // Waits for the last frames to be stored
+    if (cfg->writer != NULL) {
+        freeFrameWriter(cfg->writer);                                                       // and written
+        cfg->writer = NULL;
+    }
+    if (cfg->net_fd >= 0) {
+        close(cfg->net_fd);
+    }
+    if (cfg->stream_fd >= 0) {
+        close(cfg->stream_fd);                                                              // The parent sees the end of this worker's frames
+    }
+    if (worker.palette != NULL) {
+        freePalette(worker.palette);
+    }
+    if (worker.gpu != NULL) {
+        freeGpuRenderer(worker.gpu);
+    }
+    free(worker.cy);
+    free(worker.cx);
+    free(worker.counts);
+    freeFramePool(worker.frames);
+    freeRenderPool(worker.pool);
+}
+
+/*
+The worker's next unit: from the coordinator, the shared queue or its static block. -1 when there are none left.
+*/
+int next_unit(workerJob *job) {
+    if (job->coordinator != NULL) {
+        int unit = requestNetUnit(job->cfg.net_fd);                                         // Pull units until the coordinator says stop
+        if (unit == -2) {
+            fprintf(stderr, "Error: The coordinator %s refused this worker or went away.\n", job->coordinator);
+            exit(EXIT_FAILURE);
+        }
+        return unit;
+    }
+    if (job->queue != NULL) {
+        int i = popFrameQueue(job->queue);                                                  // Keep pulling frames until the queue is drained
+        return i >= 0 ? job->pending[i] : -1;
+    }
+    return job->start < job->end ? job->pending[job->start++] : -1;
+}
+
+/*
+Whether the unit is a frame the GPU kernel gives the CPU's counts for: a plain double precision
+frame, not a keyframe group, a float frame or a perturbed one
+*/
+int gpu_frame(const movieConfig *cfg, int unit) {
+    return cfg->keyframe_interval == 0 &&
+           frame_precision(cfg, cfg->image_width, cfg->xscale * pow(cfg->zoom_factor, unit)) == PRECISION_DOUBLE;
+}
+
+/*
+Queue frame i on the worker's GPU. Returns its slot, -1 if it couldn't be queued.
+*/
+int submit_gpu_frame(const movieConfig *cfg, movieWorker *worker, int i) {
+    double scale = cfg->xscale * pow(cfg->zoom_factor, i);
+    int max = frame_max(cfg, scale);
+    cfg->timings[i].max = max;
+    compute_coords(cfg->image_width, cfg->image_height, cfg->xcenter - scale / 2, cfg->xcenter + scale / 2,
+                   cfg->ycenter - scale / 2, cfg->ycenter + scale / 2, worker->cx, worker->cy);
+    return submitGpuFrame(worker->gpu, worker->cx, worker->cy, max);
+}
+
+/*
+Collect a frame from the GPU, then color and store it like render_frame. A frame the device lost is rendered
+again on the CPU.
+*/
+void finish_gpu_frame(const movieConfig *cfg, movieWorker *worker, const gpuFrame *flight) {
+    int i = flight->frame;
+    if (finishGpuFrame(worker->gpu, flight->slot, worker->counts) != 0) {
+        fprintf(stderr, "Warning: %s failed on frame %d, rendering it on the CPU.\n", gpuDeviceName(worker->gpu), i);
+        render_frame(cfg, worker, i);
+        return;
+    }
+    imgRawImage *img = acquireFrame(worker->frames);
+    colorize_counts(worker->pool, img, worker->counts, frame_palette(cfg, worker, cfg->timings[i].max));
+    cfg->timings[i].compute_ns = monotonicNs() - flight->start_ns;                         // Includes the wait behind the frame before
+    cfg->timings[i].worker = cfg->worker_id;
+    cfg->timings[i].precision = PRECISION_DOUBLE;
+    finish_frame(cfg, worker, img, worker->counts, i, " (gpu)");
+}
+
+void *worker_thread(void *arg) {
+    run_worker(arg);
+    return NULL;
+}
+
+/*
+Render one unit of work: a single frame, or a whole keyframe group
+*/
+void render_unit(const movieConfig *cfg, movieWorker *worker, int unit) {
+    if (cfg->keyframe_interval > 0) {
+        render_keyframe_group(cfg, worker, unit);
+    } else {
+        render_frame(cfg, worker, unit);
+    }
+}
+
+/*
+Whether every frame of a unit is already stored intact, per the manifest of a resumed render
+*/
+int unit_done(const movieConfig *cfg, int unit) {
+    if (cfg->manifest == NULL) {
+        return 0;
+    }
+    int first = cfg->keyframe_interval > 0 ? unit * cfg->keyframe_interval : unit;
+    int last = cfg->keyframe_interval > 0 ? first + cfg->keyframe_interval : first + 1;
+    for (int i = first; i < last && i < cfg->num_images; ++i) {
+        if (!cfg->manifest->done[i]) {
+            return 0;                                                                   // A keyframe group is rendered whole
+        }
+    }
+    return 1;
+}
+
+/*
+The settings that decide what a render's frames look like, for its manifest. A manifest
+written with other settings doesn't count as a checkpoint of this render.
+*/
+void manifest_fingerprint(char *buffer, size_t size, const movieConfig *cfg, const char *xcenter_text,
+                          const char *ycenter_text, int early_out) {
+    snprintf(buffer, size, "x=%s y=%s s=%.17g zoom=%.17g W=%d H=%d m=%d A=%d n=%d E=%d M=%d Y=%d D=%d F=%s K=%d T=%d C=%s "
+             "f=%s J=q%d,dct%d,sub%d,opt%d",
+             xcenter_text, ycenter_text, cfg->xscale, cfg->zoom_factor, cfg->image_width, cfg->image_height,
+             cfg->max_iterations, cfg->adaptive_max, cfg->num_images, early_out, cfg->solid_fill, cfg->mirror, cfg->deep_zoom,
+             precisionName(cfg->precision), cfg->keyframe_interval, cfg->keyframe_tolerance, cfg->palette_file ? cfg->palette_file : "-",
+             imageFormatExtension(cfg->format), cfg->jpeg.quality, cfg->jpeg.dct, cfg->jpeg.subsampling,
+             cfg->jpeg.optimize_coding);
+}
+
+/*
+Wait for the children and report any that failed or were killed. Returns the number that failed.
+*/
+int check_workers(const pid_t *pids, int num_processes) {
+    int failed = 0;
+    for (int p = 0; p < num_processes; ++p) {
+        int status;
+        if (waitpid(pids[p], &status, 0) < 0) {
+            perror("mandelmovie: waitpid");
+            failed++;
+        } else if (WIFSIGNALED(status)) {
+            fprintf(stderr, "Error: Worker %d (pid %d) was killed by signal %d (%s).\n", p, (int)pids[p],
+                    WTERMSIG(status), strsignal(WTERMSIG(status)));
+            failed++;
+        } else if (WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Error: Worker %d (pid %d) exited with status %d.\n", p, (int)pids[p], WEXITSTATUS(status));
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/*
+Render the frames of a keyframe group. The keyframe covers the first (widest)
+frame of the group at the pixel spacing of the last (deepest) one, so every
+frame in the group is a window into it (capped at KEYFRAME_MAX_OVERSIZE
+for fast zooms). A pixel takes the nearest keyframe
+count when the four keyframe samples around it are within the tolerance,
+otherwise it is iterated again.
+*/
+void render_keyframe_group(const movieConfig *cfg, movieWorker *worker, int group) {
+    renderPool *pool = worker->pool;
+    int width = cfg->image_width;
+    int height = cfg->image_height;
+    int first = group * cfg->keyframe_interval;
+    int last = first + cfg->keyframe_interval < cfg->num_images ? first + cfg->keyframe_interval - 1 : cfg->num_images - 1;
+    double key_scale = cfg->xscale * pow(cfg->zoom_factor, first);
+    double oversize = fmin(pow(cfg->zoom_factor, first - last), KEYFRAME_MAX_OVERSIZE);   // Keyframe pixels per frame pixel in the deepest frame
+    int kw = (int)ceil(width * oversize);
+    int kh = (int)ceil(height * oversize);
+    double kxmin = cfg->xcenter - key_scale / 2;
+    double kymin = cfg->ycenter - key_scale / 2;
+
+    int *key = malloc(sizeof(int) * kw * kh);
+    int *counts = worker->counts;                                                         // Frames of the group are assembled here
+    int *redo = malloc(sizeof(int) * width * height);                                     // Pixels that need iterating again
+    double *px = malloc(sizeof(double) * width * height);
+    double *py = malloc(sizeof(double) * width * height);
+    int *iters = malloc(sizeof(int) * width * height);
+    if (key == NULL || redo == NULL || px == NULL || py == NULL || iters == NULL) {
+        fprintf(stderr, "Error: Out of memory for a %dx%d keyframe.\n", kw, kh);
+        exit(EXIT_FAILURE);
+    }
+
+    int max = frame_max(cfg, cfg->xscale * pow(cfg->zoom_factor, last));                  // The whole group shares its deepest frame's cap
+    const colorPalette *palette = frame_palette(cfg, worker, max);
+    long long key_ns = monotonicNs();
+    compute_counts(pool, key, kw, kh, kxmin, kxmin + key_scale, kymin, kymin + key_scale, max, NULL);
+    key_ns = monotonicNs() - key_ns;                                                      // Counted with the group's first frame
+    long iterated = (long)kw * kh;
+
+    for (int i = first; i <= last; ++i) {
+        imgRawImage *img = acquireFrame(worker->frames);
+        long long start_ns = monotonicNs();
+        double scale = cfg->xscale * pow(cfg->zoom_factor, i);
+        double xmin = cfg->xcenter - scale / 2;
+        double ymin = cfg->ycenter - scale / 2;
+        int num_redo = 0;
+
+        for (int b = 0; b < height; ++b) {
+            double y = ymin + b * scale / height;
+            double q = (y - kymin) * kh / key_scale;                                     // Position in keyframe pixels
+            int q0 = (int)q < kh - 1 ? (int)q : kh - 2;
+            int qn = (int)(q + 0.5) < kh ? (int)(q + 0.5) : kh - 1;
+            for (int a = 0; a < width; ++a) {
+                double x = xmin + a * scale / width;
+                double p = (x - kxmin) * kw / key_scale;
+                int p0 = (int)p < kw - 1 ? (int)p : kw - 2;
+                int pn = (int)(p + 0.5) < kw ? (int)(p + 0.5) : kw - 1;
+
+                int k00 = key[q0 * kw + p0], k10 = key[q0 * kw + p0 + 1];
+                int k01 = key[(q0 + 1) * kw + p0], k11 = key[(q0 + 1) * kw + p0 + 1];
+                int lo = fmin(fmin(k00, k10), fmin(k01, k11));
+                int hi = fmax(fmax(k00, k10), fmax(k01, k11));
+                if (hi - lo <= cfg->keyframe_tolerance) {
+                    counts[b * width + a] = key[qn * kw + pn];
+                } else {
+                    redo[num_redo] = b * width + a;
+                    px[num_redo] = x;
+                    py[num_redo] = y;
+                    num_redo++;
+                }
+            }
+        }
+
+        compute_points(pool, px, py, num_redo, max, iters);
+        for (int k = 0; k < num_redo; ++k) {
+            counts[redo[k]] = iters[k];
+        }
+        iterated += num_redo;
+
+        char note[64];
+        snprintf(note, sizeof(note), " (resampled, %d pixels iterated again)", num_redo);
+        colorize_counts(pool, img, counts, palette);
+        cfg->timings[i].max = max;
+        cfg->timings[i].compute_ns = monotonicNs() - start_ns + (i == first ? key_ns : 0);
+        cfg->timings[i].worker = cfg->worker_id;
+        cfg->timings[i].precision = PRECISION_DOUBLE;                                       // Keyframe groups always iterate doubles
+        finish_frame(cfg, worker, img, counts, i, note);
+    }
+    printf("Keyframe %d-%d: iterated %ld pixels for %ld\n", first, last, iterated,
+           (long)(last - first + 1) * width * height);
+
+    free(iters);
+    free(py);
+    free(px);
+    free(redo);
+    free(key);
+}
+
+/*
+Write the per-frame stats to path once the children are done: fd:<n> for an
+already open descriptor, CSV if the name ends in .csv, JSON lines otherwise
+*/
+void write_stats(const char *path, const movieConfig *cfg) {
+    FILE *out;
+    if (strncmp(path, "fd:", 3) == 0) {
+        out = fdopen(dup(atoi(path + 3)), "w");
+    } else {
+        out = fopen(path, "w");
+    }
+    if (out == NULL) {
+        perror("mandelmovie: stats output");
+        return;
+    }
+    size_t length = strlen(path);
+    int csv = length > 4 && strcmp(path + length - 4, ".csv") == 0;
+    writeFrameTimings(out, cfg->timings, cfg->num_images, csv);
+    fclose(out);
+}
+
+/*
+Append one CSV row summing up the frame timings of this run to fname,
+with a header line first if the file is new
+*/
+void write_bench_row(const char *fname, const movieConfig *cfg, int num_processes, int num_threads,
+                     const char *kernel, int early_out, schedMode sched_mode, const char *workers,
+                     long long wall_ns) {
+    FILE *file = fopen(fname, "a");
+    if (file == NULL) {
+        perror("mandelmovie: bench file");
+        return;
+    }
+    if (ftell(file) == 0) {
+        fprintf(file, "processes,threads,kernel,early_out,solid_fill,scheduler,width,height,max,frames,"
+                      "wall_s,compute_s,encode_s,write_s,frame_compute_ms_mean,frame_compute_ms_max,mpixels_per_s,workers,build,mirror\n");
+    }
+
+    long long compute_ns = 0, encode_ns = 0, write_ns = 0, slowest_ns = 0;
+    for (int i = 0; i < cfg->num_images; ++i) {
+        compute_ns += cfg->timings[i].compute_ns;
+        encode_ns += cfg->timings[i].encode_ns;
+        write_ns += cfg->timings[i].write_ns;
+        if (cfg->timings[i].compute_ns > slowest_ns) {
+            slowest_ns = cfg->timings[i].compute_ns;
+        }
+    }
+    double pixels = (double)cfg->image_width * cfg->image_height * cfg->num_images;
+    fprintf(file, "%d,%d,%s,%d,%d,%s,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%s,%s,%d\n",
+            num_processes, num_threads, kernel, early_out, cfg->solid_fill, schedModeName(sched_mode),
+            cfg->image_width, cfg->image_height, cfg->max_iterations, cfg->num_images,
+            wall_ns / 1e9, compute_ns / 1e9, encode_ns / 1e9, write_ns / 1e9,
+            cfg->num_images > 0 ? compute_ns / 1e6 / cfg->num_images : 0.0, slowest_ns / 1e6,
+            pixels / (wall_ns / 1e9) / 1e6, workers, MANDEL_BUILD_NAME, cfg->mirror);
+    fclose(file);
+}
+
+// Show help message
+void show_help() {
+    printf("Usage: mandelmovie [options]\n");
+    printf("Options:\n");
+    printf("  -x <coord>  X coordinate of image center. Default: -0.743643\n");
+    printf("  -y <coord>  Y coordinate of image center. Default: 0.131825\n");
+    printf("  -s <scale>  Initial scale. Default: 4\n");
+    printf("  -z <scale>  Final scale of the zoom. Default: 0.001\n");
+    printf("  -W <width>  Image width in pixels. Default: 3840 (4K)\n");
+    printf("  -H <height> Image height in pixels. Default: 2160 (4K)\n");
+    printf("  -m <max>    Max iterations. Default: 1000\n");
+    printf("  -o <base>   Output filename base, an extension picks the format. Default: mandel\n");
+    printf("  -f <format> Output format: jpg, png (fast compression), ppm or raw rgb. Default: jpg\n");
+    printf("  -p <procs>  Number of processes. Default: all CPU threads\n");
+    printf("  -t <threads> Threads per process sharing each frame. Default: 1\n");
+    printf("  -k <kernel> Iteration kernel: auto, scalar, avx2, avx512 or neon. Default: auto\n");
+    printf("  -C <file>   Palette file of RRGGBB hex colors. Default: built-in scheme\n");
+    printf("  -A          Adaptive max iterations: each frame's cap grows with the zoom depth\n");
+    printf("              from %d at the start to -m at the final scale.\n", ADAPTIVE_MIN_ITERATIONS);
+    printf("  -E          Disable the cardioid/bulb and cycle detection early-outs.\n");
+    printf("  -M          Mariani-Silver solid fill of rectangles with a uniform border.\n");
+    printf("  -Y          Iterate every row instead of copying the rows mirrored across the real axis.\n");
+    printf("  -D          Deep zoom: perturbation from a high precision reference orbit, for\n");
+    printf("              final scales past double precision (down to about 1e-30).\n");
+    printf("  -K <N>      Render a keyframe every N frames and resample the frames in between.\n");
+    printf("  -T <counts> Largest spread of keyframe counts around a pixel that is reused. Default: 0\n");
+    printf("  -R <path>   Stream raw RGB frames in order to a file or named pipe (- for stdout)\n");
+    printf("              instead of writing JPEGs, e.g. for ffmpeg -f rawvideo -pix_fmt rgb24.\n");
+    printf("  -J <opts>   JPEG encoding, e.g. q=90,dct=ifast,sub=444,opt. Default: q=100,dct=islow,sub=420\n");
+    printf("  -I          Also save each frame's raw iteration counts as <base><i>.cnt for recoloring.\n");
+    printf("  -Z          Delta code and compress the saved counts.\n");
+    printf("  -V <movie>  Encode the frames into a movie as they finish, e.g. -V mandelzoom.mp4.\n");
+    printf("              Runs ffmpeg (or $MANDEL_FFMPEG) on a pipe, no image files are written.\n");
+    printf("  -c <codec>  Video codec for -V, e.g. libx264 or libx265. Default: libx264\n");
+    printf("  -B <csv>    Append a row of benchmark timings (wall, compute, encode, pixels/s) to a CSV file.\n");
+    printf("  -L <path>   Write per-frame stats (compute/encode/write ns, iterations, pixels at max,\n");
+    printf("              worker) as JSON lines, or CSV for a .csv name. fd:<n> writes to descriptor n.\n");
+    printf("  -n <images> Number of images. Default: 300\n");
+    printf("  -S <sched>  Frame scheduler: static, dynamic or lpt (predicted costliest first). Default: dynamic\n");
+    printf("  -N <port>   Coordinate a multi-node render: hand the frames out to workers connecting on port.\n");
+    printf("  -w <h:port> Work for the coordinator at host:port, each of the -p processes pulls its own frames.\n");
+    printf("  -F <prec>   Precision: double, float, perturb, or auto to pick the cheapest that is enough per frame\n");
+    printf("              from the pixel spacing (float for wide frames, perturbation past double). Default: double\n");
+    printf("  -X          Run the -p workers as threads of one process instead of forked children.\n");
+    printf("  -g <gpus>   Iterate on GPUs (OpenCL) in the first <gpus> of the -p workers, next to the CPU workers.\n");
+    printf("  -U          Plain SIMD kernels, checking for escapes after every iteration, to compare against.\n");
+    printf("  -q <frames> Frame files each worker writes at once in the background (io_uring where the kernel\n");
+    printf("              has it), 0 to write each one before going on. Default: %d\n", WRITE_DEPTH);
+    printf("  -d          Write the frame files with O_DIRECT, past the page cache.\n");
+    printf("  -a          Pin each worker's threads to cores of one NUMA node, with its buffers in that node's memory.\n");
+    printf("  -r          Resume: keep the frames <base>.manifest lists with a matching checksum, render the rest.\n");
+    printf("  -P          Preview the final image only.\n");
+    printf("  -G          With -P, write 1/16 and 1/4 resolution levels (<base>_final_1of16, _1of4) first.\n");
+    printf("  -h          Show help.\n");
+}
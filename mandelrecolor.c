@@ -0,0 +1,165 @@
+/**************************************************************
+Filename: mandelrecolor.c
+Description: Colors count files saved by mandel -I or
+mandelmovie -I with a palette and writes them as JPEGs. Only
+the colorize pass runs, so trying another palette on a whole
+zoom takes seconds instead of rendering it again.
+Compile Instructions: make mandelrecolor
+Test Instructions:
+- ./mandelmovie -I -Z -n 300
+- ./mandelrecolor -C fire.pal mandel*.cnt
+**************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "jpegrw.h"
+#include "render.h"
+#include "palette.h"
+#include "iterfile.h"
+
+// How every count file is colored and stored
+typedef struct recolorConfig {
+    const char *palette_file;                           // mandelmovie's scheme unless a palette file is given
+    int gray;                                           // Or mandel's grayscale
+    int format;                                         // An imgFormat
+    imgJpegOptions jpeg;
+} recolorConfig;
+
+static void recolor_file(const recolorConfig *cfg, renderPool *pool, const char *infile, const char *outfile);
+static void show_help();
+
+int main(int argc, char *argv[]) {
+    char c;
+    const char *outfile = NULL;                         // Next to each input unless given
+    recolorConfig cfg = {
+        .format = -1,                                   // From the -o extension unless -f is given
+        .jpeg = IMG_JPEG_DEFAULTS,                      // Quality 100, accurate DCT
+    };
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);    // Default to all available CPU threads
+
+    while ((c = getopt(argc, argv, "o:f:C:Gt:J:h")) != -1) {
+        switch (c) {
+            case 'o':
+                outfile = optarg;
+                break;
+            case 'f':
+                cfg.format = parseImageFormat(optarg);
+                if (cfg.format < 0) {
+                    fprintf(stderr, "Error: Unknown output format '%s'.\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'C':
+                cfg.palette_file = optarg;
+                break;
+            case 'G':
+                cfg.gray = 1;
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'J':
+                if (parseJpegOptions(optarg, &cfg.jpeg) < 0) {
+                    fprintf(stderr, "Error: Bad JPEG options '%s'.\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'h':
+                show_help();
+                exit(0);
+            default:
+                show_help();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc) {
+        show_help();
+        exit(EXIT_FAILURE);
+    }
+    if (outfile != NULL && argc - optind > 1) {
+        fprintf(stderr, "Error: -o only works with a single count file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (cfg.format < 0) {
+        cfg.format = outfile != NULL && imageFormatFromFilename(outfile) >= 0 ? imageFormatFromFilename(outfile) : IMG_FORMAT_JPEG;
+    }
+
+    renderPool *pool = initRenderPool(num_threads);
+    for (int f = optind; f < argc; ++f) {
+        recolor_file(&cfg, pool, argv[f], outfile);
+    }
+    freeRenderPool(pool);
+    return 0;
+}
+
+/*
+Color one count file and store it as outfile, or as the input name with _recolor and the
+format's extension in place of .cnt, so the frame rendered next to it is kept
+*/
+void recolor_file(const recolorConfig *cfg, renderPool *pool, const char *infile, const char *outfile) {
+    iterFile *file = openIterFile(infile);
+    if (file == NULL) {
+        fprintf(stderr, "Error: %s is not a readable count file.\n", infile);
+        exit(EXIT_FAILURE);
+    }
+    iterFrameInfo info;
+    getIterFileInfo(file, &info);
+
+    char imagefile[256];
+    if (outfile == NULL) {
+        const char *dot = strrchr(infile, '.');
+        int base_length = dot != NULL && strcmp(dot, ".cnt") == 0 ? dot - infile : strlen(infile);
+        if (snprintf(imagefile, sizeof(imagefile), "%.*s_recolor.%s", base_length, infile,
+                     imageFormatExtension(cfg->format)) >= sizeof(imagefile)) {
+            fprintf(stderr, "Error: Output filename too long or truncated.\n");
+            exit(EXIT_FAILURE);
+        }
+        outfile = imagefile;
+    }
+
+    colorPalette *palette = cfg->palette_file ? loadPaletteFile(cfg->palette_file, info.max)
+                          : cfg->gray ? initGrayPalette(info.max) : initMoviePalette(info.max);
+    if (palette == NULL) {
+        fprintf(stderr, "Error: Could not load palette %s.\n", cfg->palette_file);
+        exit(EXIT_FAILURE);
+    }
+
+    int *counts = malloc(sizeof(int) * info.width * info.height);
+    imgRawImage *img = initRawImage(info.width, info.height);
+    if (img == NULL) {
+        fprintf(stderr, "Error: Could not allocate a %dx%d image for %s.\n", info.width, info.height, infile);
+        exit(EXIT_FAILURE);
+    }
+    if (counts == NULL || readIterRows(file, 0, info.height, counts) != 0) {
+        fprintf(stderr, "Error: Could not read the counts in %s.\n", infile);
+        exit(EXIT_FAILURE);
+    }
+    colorize_counts(pool, img, counts, palette);
+    if (storeImageFile(img, outfile, cfg->format, &cfg->jpeg) != 0) {
+        fprintf(stderr, "Error: Could not write %s.\n", outfile);
+        exit(EXIT_FAILURE);
+    }
+    printf("Recolored: %s -> %s (%dx%d, max %d)\n", infile, outfile, info.width, info.height, info.max);
+
+    freeRawImage(img);
+    free(counts);
+    freePalette(palette);
+    closeIterFile(file);
+}
+
+// Show help message
+void show_help() {
+    printf("Usage: mandelrecolor [options] <file.cnt>...\n");
+    printf("Options:\n");
+    printf("  -o <file>   Output image for a single count file. Default: the count file with _recolor.jpg\n");
+    printf("  -f <format> Output format: jpg, png, ppm or raw. Default: from the -o extension, else jpg\n");
+    printf("  -C <file>   Palette file of RRGGBB hex colors. Default: mandelmovie's scheme\n");
+    printf("  -G          Use mandel's grayscale instead of mandelmovie's scheme.\n");
+    printf("  -t <threads> Threads coloring each image. Default: all CPU threads\n");
+    printf("  -J <opts>   JPEG encoding, e.g. q=90,dct=ifast,sub=444,opt. Default: q=100,dct=islow,sub=420\n");
+    printf("  -h          Show help.\n");
+}
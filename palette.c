@@ -0,0 +1,114 @@
+/**************************************************************
+Filename: palette.c
+Description: Iteration count to color lookup tables. The color
+only depends on the iteration count and max, so each scheme is
+evaluated once per entry here instead of once per pixel.
+**************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "palette.h"
+
+static colorPalette *alloc_palette(int max) {
+    colorPalette *palette = malloc(sizeof(colorPalette));
+    if (palette == NULL) {
+        return NULL;
+    }
+    palette->max = max;
+    palette->rgb = malloc(sizeof(unsigned int) * (max + 1));
+    if (palette->rgb == NULL) {
+        free(palette);
+        return NULL;
+    }
+    return palette;
+}
+
+colorPalette *initMoviePalette(int max) {
+    colorPalette *palette = alloc_palette(max);
+    if (palette == NULL) {
+        return NULL;
+    }
+
+    for (int iters = 0; iters < max; ++iters) {
+        double t = (double)iters / max;
+        unsigned char red = (unsigned char)(9 * (1 - t) * pow(t, 3) * 255);
+        unsigned char green = (unsigned char)(15 * pow((1 - t), 2) * pow(t, 2) * 255);
+        unsigned char blue = (unsigned char)(8.5 * pow((1 - t), 3) * t * 255);
+        palette->rgb[iters] = (red << 16) | (green << 8) | blue;
+    }
+    palette->rgb[max] = 0x000000;
+    return palette;
+}
+
+colorPalette *initGrayPalette(int max) {
+    colorPalette *palette = alloc_palette(max);
+    if (palette == NULL) {
+        return NULL;
+    }
+
+    for (int iters = 0; iters <= max; ++iters) {
+        int color = 0xFFFFFF * iters / (double)max;
+        palette->rgb[iters] = color;
+    }
+    return palette;
+}
+
+colorPalette *loadPaletteFile(const char *fname, int max) {
+    FILE *fp = fopen(fname, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    int count = 0;
+    int capacity = 16;
+    unsigned int *stops = malloc(sizeof(unsigned int) * capacity);
+    unsigned int color;
+    while (stops != NULL && (fscanf(fp, " #%6x", &color) == 1 || fscanf(fp, " %6x", &color) == 1)) {
+        if (count == capacity) {
+            capacity *= 2;
+            unsigned int *grown = realloc(stops, sizeof(unsigned int) * capacity);
+            if (grown == NULL) {
+                free(stops);
+                stops = NULL;
+                break;
+            }
+            stops = grown;
+        }
+        stops[count++] = color;
+    }
+    fclose(fp);
+
+    colorPalette *palette = (stops != NULL && count > 0) ? alloc_palette(max) : NULL;
+    if (palette == NULL) {
+        free(stops);
+        return NULL;
+    }
+
+    // Linearly blend between the file's colors across the escaping counts
+    for (int iters = 0; iters < max; ++iters) {
+        double pos = (count == 1 || max == 1) ? 0 : (double)iters * (count - 1) / (max - 1);
+        int lo = (int)pos;
+        int hi = lo + 1 < count ? lo + 1 : lo;
+        double f = pos - lo;
+        unsigned int rgb = 0;
+        for (int shift = 16; shift >= 0; shift -= 8) {
+            double a = (stops[lo] >> shift) & 0xFF;
+            double b = (stops[hi] >> shift) & 0xFF;
+            rgb |= (unsigned int)(a + (b - a) * f + 0.5) << shift;
+        }
+        palette->rgb[iters] = rgb;
+    }
+    palette->rgb[max] = 0x000000;
+
+    free(stops);
+    return palette;
+}
+
+void freePalette(colorPalette *palette) {
+    if (palette == NULL) {
+        return;
+    }
+    free(palette->rgb);
+    free(palette);
+}
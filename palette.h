@@ -0,0 +1,23 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+// A color for every possible iteration count, built once per run
+typedef struct colorPalette {
+	int max;            // entries run from 0 to max iterations
+	unsigned int* rgb;  // max+1 colors as 0xRRGGBB
+} colorPalette;
+
+// mandelmovie's color scheme - points that never escape are black
+colorPalette* initMoviePalette(int max);
+
+// mandel's scheme, 0xFFFFFF scaled by iters/max
+colorPalette* initGrayPalette(int max);
+
+// Read whitespace separated RRGGBB hex colors (a leading # is optional)
+// and stretch them across 0..max-1 iterations, points at max are black.
+// Returns NULL if the file can't be read or holds no colors.
+colorPalette* loadPaletteFile(const char* fname, int max);
+
+void freePalette(colorPalette* palette);
+
+#endif  /* Compile guard */
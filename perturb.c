@@ -0,0 +1,99 @@
+/**************************************************************
+Filename: perturb.c
+Description: Perturbation theory for zooms deeper than double
+precision allows. One reference orbit Z_n is computed per frame
+at the frame center in high precision. Each pixel c = C + dc then
+only iterates its delta from that orbit in doubles:
+    d_{n+1} = 2 Z_n d_n + d_n^2 + dc
+Glitches come from the delta growing as large as the orbit itself.
+They are handled by rebasing: when |Z_n + d_n| < |d_n|, or the
+reference orbit runs out, the pixel's full value becomes its new
+delta and it restarts from Z_0 = 0.
+**************************************************************/
+
+#include <stdlib.h>
+#include "perturb.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <quadmath.h>
+#endif
+
+deepFloat parseDeepFloat(const char *text) {
+#if defined(__x86_64__) || defined(__i386__)
+    return strtoflt128(text, NULL);
+#else
+    return strtold(text, NULL);
+#endif
+}
+
+refOrbit *initRefOrbit(deepFloat cx, deepFloat cy, int max) {
+    refOrbit *ref = malloc(sizeof(refOrbit));
+    if (ref == NULL) {
+        return NULL;
+    }
+    ref->zx = malloc(sizeof(double) * (max + 2));
+    ref->zy = malloc(sizeof(double) * (max + 2));
+    if (ref->zx == NULL || ref->zy == NULL) {
+        freeRefOrbit(ref);
+        return NULL;
+    }
+
+    deepFloat x = 0;
+    deepFloat y = 0;
+    int n = 0;
+    ref->zx[0] = 0;
+    ref->zy[0] = 0;
+
+    // The pixel iteration starts at Z_1 = C, so keep up to max+1 points
+    while (n <= max && x * x + y * y <= 4) {
+        deepFloat xt = x * x - y * y + cx;
+        deepFloat yt = 2 * x * y + cy;
+        x = xt;
+        y = yt;
+        n++;
+        ref->zx[n] = (double)x;
+        ref->zy[n] = (double)y;
+    }
+    ref->length = n + 1;
+    return ref;
+}
+
+void freeRefOrbit(refOrbit *ref) {
+    if (ref == NULL) {
+        return;
+    }
+    free(ref->zx);
+    free(ref->zy);
+    free(ref);
+}
+
+int iterations_perturbed(const refOrbit *ref, double dcx, double dcy, int max) {
+    int m = 1;                                              // z starts at c, which is Z_1 + dc
+    double dx = dcx;
+    double dy = dcy;
+    double zx = ref->zx[1] + dx;
+    double zy = ref->zy[1] + dy;
+    int iter = 0;
+
+    while ((zx * zx + zy * zy <= 4) && iter < max) {
+        if (m == ref->length - 1 || zx * zx + zy * zy < dx * dx + dy * dy) {
+            dx = zx;                                        // rebase onto Z_0 = 0
+            dy = zy;
+            m = 0;
+        }
+
+        double Zx = ref->zx[m];
+        double Zy = ref->zy[m];
+        double dxt = 2 * (Zx * dx - Zy * dy) + (dx * dx - dy * dy) + dcx;
+        double dyt = 2 * (Zx * dy + Zy * dx) + 2 * dx * dy + dcy;
+        dx = dxt;
+        dy = dyt;
+        m++;
+        iter++;
+
+        zx = ref->zx[m] + dx;
+        zy = ref->zy[m] + dy;
+    }
+
+    return iter;
+}
@@ -0,0 +1,33 @@
+#ifndef PERTURB_H
+#define PERTURB_H
+
+// The precision of the reference orbit. __float128 gives about 34
+// significant digits, enough for zooms down to a scale of ~1e-30.
+#if defined(__x86_64__) || defined(__i386__)
+typedef __float128 deepFloat;
+#else
+typedef long double deepFloat;
+#endif
+
+// The orbit of the frame's center point, computed once in high precision
+// and rounded to doubles for the per-pixel delta iterations
+typedef struct refOrbit {
+	int length;     // number of stored points, Z_0 = 0 through the escape
+	double* zx;
+	double* zy;
+} refOrbit;
+
+// parse a coordinate without losing digits past double precision
+deepFloat parseDeepFloat(const char* text);
+
+// iterate the center (cx,cy) up to max iterations - NULL if out of memory
+refOrbit* initRefOrbit(deepFloat cx, deepFloat cy, int max);
+
+void freeRefOrbit(refOrbit* ref);
+
+// Return the number of iterations at the point (dcx,dcy) away from the
+// reference center, up to a maximum of max. Only the small delta from the
+// reference orbit is iterated in double precision.
+int iterations_perturbed(const refOrbit* ref, double dcx, double dcy, int max);
+
+#endif  /* Compile guard */
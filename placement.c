@@ -0,0 +1,122 @@
+/**************************************************************
+Filename: placement.c
+Description: Core pinning and NUMA node placement for the
+workers of mandelmovie, so a worker's threads share a socket
+and its frame buffers sit in that socket's memory. Reads the
+topology from sysfs and sets policies with plain system calls,
+no libnuma needed.
+**************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "placement.h"
+
+#define PLACE_MAX_NODES 64
+
+/*
+Read a sysfs CPU list such as "0-23,48-71" into set, keeping only the CPUs in allowed
+*/
+static int read_cpulist(const char *path, const cpu_set_t *allowed, cpu_set_t *set) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    char list[4096];
+    int ok = fgets(list, sizeof(list), file) != NULL;
+    fclose(file);
+    if (!ok) {
+        return -1;
+    }
+
+    CPU_ZERO(set);
+    char *save;
+    for (char *range = strtok_r(list, ",\n", &save); range != NULL; range = strtok_r(NULL, ",\n", &save)) {
+        int first, last;
+        int n = sscanf(range, "%d-%d", &first, &last);
+        if (n < 1) {
+            continue;
+        }
+        if (n == 1) {
+            last = first;
+        }
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, allowed)) {
+                CPU_SET(cpu, set);
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+The nodes with CPUs we may use, and those CPUs. Returns the number of nodes.
+*/
+static int read_nodes(cpu_set_t *node_cpus, int *node_ids) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return 0;
+    }
+
+    int num_nodes = 0;
+    for (int node = 0; node < PLACE_MAX_NODES; ++node) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (read_cpulist(path, &allowed, &node_cpus[num_nodes]) == 0 && CPU_COUNT(&node_cpus[num_nodes]) > 0) {
+            node_ids[num_nodes++] = node;
+        }
+    }
+    if (num_nodes == 0) {
+        node_cpus[0] = allowed;                                     // No NUMA information, one node
+        node_ids[0] = 0;
+        num_nodes = CPU_COUNT(&allowed) > 0;
+    }
+    return num_nodes;
+}
+
+int placeWorker(int worker, int numThreads, int *cpus) {
+    cpu_set_t node_cpus[PLACE_MAX_NODES];
+    int node_ids[PLACE_MAX_NODES];
+    int num_nodes = read_nodes(node_cpus, node_ids);
+    if (num_nodes == 0) {
+        return -1;
+    }
+
+    int n = worker % num_nodes;                                     // Round robin over the nodes spreads the memory traffic
+    int slot = worker / num_nodes;                                  // This worker's place among the node's workers
+    int count = CPU_COUNT(&node_cpus[n]);
+    int first = slot * numThreads;
+    for (int t = 0; t < numThreads; ++t) {
+        int want = (first + t) % count, seen = 0;                   // More threads than cores wrap around
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &node_cpus[n]) && seen++ == want) {
+                cpus[t] = cpu;
+                break;
+            }
+        }
+    }
+    return node_ids[n];
+}
+
+int pinThread(const int *cpus, int n) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int t = 0; t < n; ++t) {
+        CPU_SET(cpus[t], &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+int preferNode(int node) {
+    if (node < 0 || node >= (int)(8 * sizeof(unsigned long))) {
+        return -1;
+    }
+    unsigned long mask = 1UL << node;
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, 8 * sizeof(mask)) == 0 ? 0 : -1;
+}
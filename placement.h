@@ -0,0 +1,23 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+// Where mandelmovie's workers run on a multi-socket machine. Each worker is
+// kept on one NUMA node, the workers are spread over the nodes in turn, and
+// the threads of a worker get cores of their own next to each other on the
+// node. The topology comes from /sys/devices/system/node, limited to the
+// CPUs the process may run on. A machine without one counts as one node.
+
+// Fill cpus[0..numThreads-1] with the cores of the threads of the given
+// worker. Returns the worker's node, -1 if there are no CPUs.
+int placeWorker(int worker, int numThreads, int* cpus);
+
+// restrict the calling thread to the given cores - returns 0 on success
+int pinThread(const int* cpus, int n);
+
+// Have the calling thread's memory, and that of the threads it starts
+// from here on, come from node when it has room. Pages are placed when
+// first touched, so buffers allocated and prefaulted after this are local.
+// Returns 0 on success.
+int preferNode(int node);
+
+#endif  /* Compile guard */
@@ -0,0 +1,682 @@
+/**************************************************************
+Filename: render.c
+Description: The threaded renderer shared by mandel and
+mandelmovie. Rendering is two passes: the kernel stage fills a
+buffer of iteration counts, then the colorize stage maps the
+counts through the palette into the image. For the kernel stage
+a frame is cut into bands of rows, and the threads of a renderPool
+pull the next band from a shared counter until the frame is done.
+Each row goes through the kernel in one call.
+With solid fill on, the frame is cut into tiles instead, and each
+tile is rendered Mariani-Silver style: iterate the border, fill the
+whole rectangle if the border is a single count, otherwise split it
+in four and repeat. Only the kernel's iterate_points() is used, so
+this works with every kernel.
+compute_image_perturbed renders the same way, but the coordinates
+are deltas from a reference orbit and each point goes through the
+perturbation iteration instead of the kernel.
+compute_points spreads an arbitrary list of points over the pool
+in chunks.
+The set is symmetric about the real axis, so when a frame crosses
+it, its rows are shifted by at most a quarter row to line up with
+their mirror images, and the rows below the axis that have a mirror
+above it are copied instead of iterated.
+**************************************************************/
+
+#define _GNU_SOURCE                     // pthread_setaffinity_np
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <pthread.h>
+#include "render.h"
+#include "kernel.h"
+#include "perturb.h"
+
+#define BAND_ROWS 8                     // rows handed out to a thread at a time
+#define TILE_SIZE 64                    // solid-fill tiles handed out to a thread at a time
+#define MIN_SPLIT 6                     // solid-fill rectangles this small are just iterated
+#define POINT_CHUNK 512                 // points handed out to a thread at a time
+
+// How a job is cut into tasks
+typedef enum taskKind {
+    TASK_BANDS,
+    TASK_TILES,
+    TASK_POINTS,
+    TASK_COLORIZE
+} taskKind;
+
+// Everything a worker needs to render its share of one frame
+typedef struct renderJob {
+    taskKind kind;
+    int width;
+    int height;
+    int max;
+    imgRawImage *img;                   // colorize only: the image and the palette entry
+    const unsigned int *rgb;            // for every iteration count
+    const refOrbit *ref;                // perturbation only: the frame's reference orbit
+    int single;                         // iterate with the float kernel
+    const double *cx;                   // x coordinate of every column (delta from the reference if ref is set)
+    const double *cy;                   // y coordinate of every row
+    int *counts;                        // iteration count of every pixel
+    int tiles_x;                        // solid fill only: tiles per row of the frame
+    const double *px;                   // points only: the points and where their counts go
+    const double *py;
+    int *out;
+    int num_points;
+    int num_tasks;                      // bands, tiles or point chunks
+    int next_task;                      // only touched atomically
+    long skipped;                       // pixels filled without iterating, only touched atomically
+} renderJob;
+
+// Per-thread buffers for feeding points to the kernel
+typedef struct renderScratch {
+    double *px;
+    double *py;
+    int *iters;
+} renderScratch;
+
+static int solid_fill = 0;
+static int mirror_axis = 1;
+
+// Color n counts into the image's row j from column i0, straight into the row
+static void colorize_span(imgRawImage *img, const unsigned int *rgb, int j, int i0, const int *counts, int n) {
+    unsigned char *px = getRowRGB(img, j) + i0 * 3;
+    for (int i = 0; i < n; ++i) {
+        unsigned int c = rgb[counts[i]];
+        px[0] = c >> 16;
+        px[1] = c >> 8;
+        px[2] = c;
+        px += 3;
+    }
+}
+
+struct renderPool {
+    int num_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    renderJob *job;
+    unsigned long generation;           // bumped for every new job
+    int busy;                           // helpers still working on the current job
+    int shutdown;
+};
+
+void setSolidFill(int enabled) {
+    solid_fill = enabled;
+}
+
+void setMirror(int enabled) {
+    mirror_axis = enabled;
+}
+
+// Iterate n points of the job, with the kernel or against the reference orbit
+static void iterate_job_points(const renderJob *job, const double *px, const double *py, int n, int *iters) {
+    if (job->single) {
+        iterate_points_float(px, py, n, job->max, iters);
+        return;
+    }
+    if (job->ref == NULL) {
+        iterate_points(px, py, n, job->max, iters);
+        return;
+    }
+    for (int k = 0; k < n; ++k) {
+        iters[k] = iterations_perturbed(job->ref, px[k], py[k], job->max);
+    }
+}
+
+// Render bands of rows until the job has none left
+static void run_bands(renderJob *job, renderScratch *scratch) {
+    int width = job->width;
+    int height = job->height;
+    int band;
+
+    while ((band = __atomic_fetch_add(&job->next_task, 1, __ATOMIC_RELAXED)) < job->num_tasks) {
+        int jend = (band + 1) * BAND_ROWS < height ? (band + 1) * BAND_ROWS : height;
+        for (int j = band * BAND_ROWS; j < jend; ++j) {
+            for (int i = 0; i < width; ++i) {
+                scratch->py[i] = job->cy[j];
+            }
+            iterate_job_points(job, job->cx, scratch->py, width, job->counts + j * width);
+        }
+    }
+}
+
+// Color bands of rows until the job has none left
+static void run_colorize(renderJob *job) {
+    int width = job->width;
+    int height = job->height;
+    int band;
+
+    while ((band = __atomic_fetch_add(&job->next_task, 1, __ATOMIC_RELAXED)) < job->num_tasks) {
+        int jend = (band + 1) * BAND_ROWS < height ? (band + 1) * BAND_ROWS : height;
+        for (int j = band * BAND_ROWS; j < jend; ++j) {
+            colorize_span(job->img, job->rgb, j, 0, job->counts + j * width, width);
+        }
+    }
+}
+
+// Iterate chunks of the job's point list until there are none left
+static void run_points(renderJob *job) {
+    int chunk;
+
+    while ((chunk = __atomic_fetch_add(&job->next_task, 1, __ATOMIC_RELAXED)) < job->num_tasks) {
+        int k = chunk * POINT_CHUNK;
+        int n = k + POINT_CHUNK < job->num_points ? POINT_CHUNK : job->num_points - k;
+        iterate_job_points(job, job->px + k, job->py + k, n, job->out + k);
+    }
+}
+
+// Iterate pixels i0..i1 of row j into the count buffer
+static void iterate_row_span(renderJob *job, renderScratch *scratch, int j, int i0, int i1) {
+    int n = i1 - i0 + 1;
+    if (n <= 0) {
+        return;
+    }
+    for (int k = 0; k < n; ++k) {
+        scratch->py[k] = job->cy[j];
+    }
+    iterate_job_points(job, job->cx + i0, scratch->py, n, job->counts + j * job->width + i0);
+}
+
+// Iterate pixels j0..j1 of column i into the count buffer
+static void iterate_col_span(renderJob *job, renderScratch *scratch, int i, int j0, int j1) {
+    int n = j1 - j0 + 1;
+    int width = job->width;
+    if (n <= 0) {
+        return;
+    }
+    for (int k = 0; k < n; ++k) {
+        scratch->px[k] = job->cx[i];
+    }
+    iterate_job_points(job, scratch->px, job->cy + j0, n, scratch->iters);
+    for (int k = 0; k < n; ++k) {
+        job->counts[(j0 + k) * width + i] = scratch->iters[k];
+    }
+}
+
+// The border of (i0,j0)-(i1,j1) is already iterated - fill or split the inside.
+// Returns the number of pixels filled without iterating.
+static long subdivide(renderJob *job, renderScratch *scratch, int i0, int j0, int i1, int j1) {
+    int width = job->width;
+    int *counts = job->counts;
+    int value = counts[j0 * width + i0];
+    int uniform = 1;
+
+    for (int i = i0; i <= i1 && uniform; ++i) {
+        uniform = counts[j0 * width + i] == value && counts[j1 * width + i] == value;
+    }
+    for (int j = j0; j <= j1 && uniform; ++j) {
+        uniform = counts[j * width + i0] == value && counts[j * width + i1] == value;
+    }
+
+    if (uniform) {
+        long filled = 0;
+        for (int j = j0 + 1; j < j1; ++j) {
+            for (int i = i0 + 1; i < i1; ++i) {
+                counts[j * width + i] = value;
+            }
+            filled += i1 - i0 - 1 > 0 ? i1 - i0 - 1 : 0;
+        }
+        return filled;
+    }
+
+    if (i1 - i0 < MIN_SPLIT || j1 - j0 < MIN_SPLIT) {
+        for (int j = j0 + 1; j < j1; ++j) {
+            iterate_row_span(job, scratch, j, i0 + 1, i1 - 1);
+        }
+        return 0;
+    }
+
+    int im = (i0 + i1) / 2;
+    int jm = (j0 + j1) / 2;
+    iterate_row_span(job, scratch, jm, i0 + 1, i1 - 1);
+    iterate_col_span(job, scratch, im, j0 + 1, jm - 1);
+    iterate_col_span(job, scratch, im, jm + 1, j1 - 1);
+
+    return subdivide(job, scratch, i0, j0, im, jm) + subdivide(job, scratch, im, j0, i1, jm) +
+           subdivide(job, scratch, i0, jm, im, j1) + subdivide(job, scratch, im, jm, i1, j1);
+}
+
+// Render solid-fill tiles until the job has none left
+static void run_tiles(renderJob *job, renderScratch *scratch) {
+    int width = job->width;
+    int height = job->height;
+    int tile;
+
+    while ((tile = __atomic_fetch_add(&job->next_task, 1, __ATOMIC_RELAXED)) < job->num_tasks) {
+        int i0 = (tile % job->tiles_x) * TILE_SIZE;
+        int j0 = (tile / job->tiles_x) * TILE_SIZE;
+        int i1 = (i0 + TILE_SIZE < width ? i0 + TILE_SIZE : width) - 1;
+        int j1 = (j0 + TILE_SIZE < height ? j0 + TILE_SIZE : height) - 1;
+
+        iterate_row_span(job, scratch, j0, i0, i1);
+        if (j1 > j0) {
+            iterate_row_span(job, scratch, j1, i0, i1);
+        }
+        iterate_col_span(job, scratch, i0, j0 + 1, j1 - 1);
+        if (i1 > i0) {
+            iterate_col_span(job, scratch, i1, j0 + 1, j1 - 1);
+        }
+        long filled = subdivide(job, scratch, i0, j0, i1, j1);
+        __atomic_fetch_add(&job->skipped, filled, __ATOMIC_RELAXED);
+    }
+}
+
+static void run_job(renderJob *job) {
+    if (job->kind == TASK_POINTS) {
+        run_points(job);
+        return;
+    }
+    if (job->kind == TASK_COLORIZE) {
+        run_colorize(job);
+        return;
+    }
+
+    int longest = job->width > job->height ? job->width : job->height;
+    renderScratch scratch = {
+        .px = malloc(sizeof(double) * longest),
+        .py = malloc(sizeof(double) * longest),
+        .iters = malloc(sizeof(int) * longest),
+    };
+
+    if (job->kind == TASK_TILES) {
+        run_tiles(job, &scratch);
+    } else {
+        run_bands(job, &scratch);
+    }
+
+    free(scratch.iters);
+    free(scratch.py);
+    free(scratch.px);
+}
+
+static void *pool_worker(void *arg) {
+    renderPool *pool = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->job_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        renderJob *job = pool->job;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_job(job);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+renderPool *initRenderPool(int numThreads) {
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+
+    renderPool *pool = calloc(1, sizeof(renderPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->num_threads = numThreads;
+    pool->threads = calloc(numThreads, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+
+    for (int t = 1; t < numThreads; ++t) {                  // thread 0 is the caller of compute_image
+        if (pthread_create(&pool->threads[t], NULL, pool_worker, pool) != 0) {
+            pool->num_threads = t;
+            freeRenderPool(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void freeRenderPool(renderPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int t = 1; t < pool->num_threads; ++t) {
+        pthread_join(pool->threads[t], NULL);
+    }
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+int renderPoolThreads(const renderPool *pool) {
+    return pool == NULL ? 1 : pool->num_threads;
+}
+
+int pinRenderPool(renderPool *pool, const int *cpus) {
+    int result = 0;
+    for (int t = 0; t < renderPoolThreads(pool); ++t) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[t], &set);
+        result |= pthread_setaffinity_np(t == 0 ? pthread_self() : pool->threads[t], sizeof(set), &set);
+    }
+    return result;
+}
+
+// Run the job on the pool's threads and the calling thread
+static void dispatch(renderPool *pool, renderJob *job) {
+    if (pool != NULL && pool->num_threads > 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->job = job;
+        pool->busy = pool->num_threads - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->job_ready);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    run_job(job);                                           // the caller works on the frame too
+
+    if (pool != NULL && pool->num_threads > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->busy > 0) {
+            pthread_cond_wait(&pool->job_done, &pool->lock);
+        }
+        pool->job = NULL;
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Cut a frame job into bands or solid-fill tiles and run it
+static void run_frame(renderPool *pool, renderJob *job, renderStats *stats) {
+    job->kind = TASK_BANDS;
+    job->num_tasks = (job->height + BAND_ROWS - 1) / BAND_ROWS;
+    if (solid_fill) {
+        job->kind = TASK_TILES;
+        job->tiles_x = (job->width + TILE_SIZE - 1) / TILE_SIZE;
+        job->num_tasks = job->tiles_x * ((job->height + TILE_SIZE - 1) / TILE_SIZE);
+    }
+
+    dispatch(pool, job);
+
+    if (stats != NULL) {
+        stats->pixels_skipped = job->skipped;
+    }
+}
+
+// The rows of a frame from ymin to ymax that mirror others across the real
+// axis once the rows are snapped onto the axis: row j of c0..c1-1 is the
+// image of row r-j. Returns r, or 0 if the frame doesn't cross the axis, no
+// row has a partner, or symmetry is turned off.
+static int mirror_rows(int height, double ymin, double ymax, int *c0, int *c1) {
+    if (!mirror_axis || !(ymin < 0 && ymax > 0)) {
+        return 0;
+    }
+    double r = round(-2 * ymin / ((ymax - ymin) / height));            // ymin + (r-j)*dy = -(ymin + j*dy)
+    if (r < 1) {
+        return 0;
+    }
+    *c0 = r - height + 1 > 0 ? r - height + 1 : 0;
+    *c1 = ((int)r + 1) / 2;                                              // j < r-j, the row on the axis has no partner
+    return *c0 < *c1 ? r : 0;
+}
+
+// x and y coordinates of every column and row of the range. With mirror set
+// and rows to mirror, the rows are shifted by at most a quarter row so that
+// row r/2 falls on the axis. Row j is then (j - r/2) * dy, exactly the
+// negation of row r-j, so copying the counts over gives what iterating
+// them would.
+static void fill_coords(int width, int height, double xmin, double xmax, double ymin, double ymax,
+                        int mirror, double *cx, double *cy) {
+    for (int i = 0; i < width; ++i) {
+        cx[i] = xmin + i * (xmax - xmin) / width;
+    }
+    int c0, c1, r;
+    if (mirror && (r = mirror_rows(height, ymin, ymax, &c0, &c1)) > 0) {
+        double dy = (ymax - ymin) / height;
+        for (int j = 0; j < height; ++j) {
+            cy[j] = (j - r / 2.0) * dy;                                 // Snapped so row r/2 is on the axis
+        }
+        return;
+    }
+    for (int j = 0; j < height; ++j) {
+        cy[j] = ymin + j * (ymax - ymin) / height;
+    }
+}
+
+// fill_coords into new arrays
+static void pixel_coords(int width, int height, double xmin, double xmax, double ymin, double ymax,
+                         int mirror, double **cx, double **cy) {
+    *cx = malloc(sizeof(double) * width);
+    *cy = malloc(sizeof(double) * height);
+    fill_coords(width, height, xmin, xmax, ymin, ymax, mirror, *cx, *cy);
+}
+
+void compute_coords(int width, int height, double xmin, double xmax, double ymin, double ymax, double *cx, double *cy) {
+    fill_coords(width, height, xmin, xmax, ymin, ymax, 1, cx, cy);
+}
+
+// run_frame for a frame from ymin to ymax that may cross the real axis: the
+// rows mirroring others are left out of the job and copied from their
+// partners afterwards. The job's cy must come from pixel_coords with mirror set.
+static void run_mirrored_frame(renderPool *pool, renderJob *job, double ymin, double ymax, renderStats *stats) {
+    int c0, c1;
+    int r = mirror_rows(job->height, ymin, ymax, &c0, &c1);
+    if (r == 0) {
+        run_frame(pool, job, stats);
+        if (stats != NULL) {
+            stats->pixels_mirrored = 0;
+        }
+        return;
+    }
+
+    int width = job->width;
+    long skipped = 0;
+    int starts[2] = { 0, c1 };
+    int ends[2] = { c0, job->height };
+    for (int s = 0; s < 2; ++s) {                                       // Below and above the mirrored rows
+        if (ends[s] > starts[s]) {
+            renderJob part = *job;
+            part.height = ends[s] - starts[s];
+            part.cy = job->cy + starts[s];
+            part.counts = job->counts + starts[s] * width;
+            run_frame(pool, &part, NULL);
+            skipped += part.skipped;
+        }
+    }
+    for (int j = c0; j < c1; ++j) {
+        memcpy(job->counts + j * width, job->counts + (r - j) * width, sizeof(int) * width);
+    }
+
+    if (stats != NULL) {
+        stats->pixels_skipped = skipped;
+        stats->pixels_mirrored = (long)(c1 - c0) * width;
+    }
+}
+
+void compute_counts(renderPool *pool, int *counts, int width, int height, double xmin, double xmax,
+                    double ymin, double ymax, int max, renderStats *stats) {
+    double *cx, *cy;
+    pixel_coords(width, height, xmin, xmax, ymin, ymax, 1, &cx, &cy);
+
+    renderJob job = {
+        .width = width,
+        .height = height,
+        .max = max,
+        .cx = cx,
+        .cy = cy,
+        .counts = counts,
+    };
+    run_mirrored_frame(pool, &job, ymin, ymax, stats);
+
+    free(cy);
+    free(cx);
+}
+
+void compute_counts_float(renderPool *pool, int *counts, int width, int height, double xmin, double xmax,
+                          double ymin, double ymax, int max, renderStats *stats) {
+    double *cx, *cy;
+    pixel_coords(width, height, xmin, xmax, ymin, ymax, 1, &cx, &cy);
+
+    renderJob job = {
+        .width = width,
+        .height = height,
+        .max = max,
+        .single = 1,
+        .cx = cx,
+        .cy = cy,
+        .counts = counts,
+    };
+    run_mirrored_frame(pool, &job, ymin, ymax, stats);
+
+    free(cy);
+    free(cx);
+}
+
+void compute_counts_perturbed(renderPool *pool, int *counts, int width, int height, const refOrbit *ref,
+                              double xspan, double yspan, int max, renderStats *stats) {
+    double *cx, *cy;
+    pixel_coords(width, height, -xspan / 2, xspan / 2, -yspan / 2, yspan / 2, 0, &cx, &cy);
+
+    renderJob job = {
+        .width = width,
+        .height = height,
+        .max = max,
+        .ref = ref,
+        .cx = cx,
+        .cy = cy,
+        .counts = counts,
+    };
+    run_frame(pool, &job, stats);
+    if (stats != NULL) {
+        stats->pixels_mirrored = 0;                                     // Deltas from the reference aren't symmetric
+    }
+
+    free(cy);
+    free(cx);
+}
+
+void colorize_counts(renderPool *pool, imgRawImage *img, const int *counts, const colorPalette *palette) {
+    renderJob job = {
+        .kind = TASK_COLORIZE,
+        .width = img->width,
+        .height = img->height,
+        .img = img,
+        .rgb = palette->rgb,
+        .counts = (int *)counts,
+        .num_tasks = (img->height + BAND_ROWS - 1) / BAND_ROWS,
+    };
+    dispatch(pool, &job);
+}
+
+void compute_image(renderPool *pool, imgRawImage *img, double xmin, double xmax,
+                   double ymin, double ymax, int max, const colorPalette *palette,
+                   renderStats *stats) {
+    int *counts = malloc(sizeof(int) * img->width * img->height);
+    compute_counts(pool, counts, img->width, img->height, xmin, xmax, ymin, ymax, max, stats);
+    colorize_counts(pool, img, counts, palette);
+    free(counts);
+}
+
+void compute_image_perturbed(renderPool *pool, imgRawImage *img, const refOrbit *ref,
+                             double xspan, double yspan, int max, const colorPalette *palette,
+                             renderStats *stats) {
+    int *counts = malloc(sizeof(int) * img->width * img->height);
+    compute_counts_perturbed(pool, counts, img->width, img->height, ref, xspan, yspan, max, stats);
+    colorize_counts(pool, img, counts, palette);
+    free(counts);
+}
+
+void compute_counts_progressive(renderPool *pool, int *counts, int width, int height, double xmin, double xmax,
+                                double ymin, double ymax, const refOrbit *ref, int max,
+                                progressLevelFn level_done, void *context) {
+    double *cx, *cy;
+    pixel_coords(width, height, xmin, xmax, ymin, ymax, ref == NULL, &cx, &cy);    // The same rows as compute_counts
+    long capacity = (long)width * height;
+    double *px = malloc(sizeof(double) * capacity);
+    double *py = malloc(sizeof(double) * capacity);
+    int *iters = malloc(sizeof(int) * capacity);
+    int *index = malloc(sizeof(int) * capacity);
+
+    for (int stride = PROGRESSIVE_FIRST_STRIDE, done = 0; stride >= 1; done = stride, stride /= 2) {
+        int n = 0;
+        for (int j = 0; j < height; j += stride) {
+            for (int i = 0; i < width; i += stride) {
+                if (done > 0 && i % done == 0 && j % done == 0) {
+                    continue;                                       // Already iterated by a coarser level
+                }
+                px[n] = cx[i];
+                py[n] = cy[j];
+                index[n++] = j * width + i;
+            }
+        }
+
+        renderJob job = {
+            .kind = TASK_POINTS,
+            .max = max,
+            .ref = ref,
+            .px = px,
+            .py = py,
+            .out = iters,
+            .num_points = n,
+            .num_tasks = (n + POINT_CHUNK - 1) / POINT_CHUNK,
+        };
+        dispatch(pool, &job);
+        for (int k = 0; k < n; ++k) {
+            counts[index[k]] = iters[k];
+        }
+        if (level_done != NULL) {
+            level_done(context, counts, stride);
+        }
+    }
+
+    free(index);
+    free(iters);
+    free(py);
+    free(px);
+    free(cy);
+    free(cx);
+}
+
+void colorize_level(renderPool *pool, imgRawImage *img, const int *counts, int width, int stride,
+                    const colorPalette *palette) {
+    int *level = malloc(sizeof(int) * img->width * img->height);
+    for (int j = 0; j < img->height; ++j) {
+        for (int i = 0; i < img->width; ++i) {
+            level[j * img->width + i] = counts[(long)j * stride * width + i * stride];
+        }
+    }
+    colorize_counts(pool, img, level, palette);
+    free(level);
+}
+
+void compute_points(renderPool *pool, const double *px, const double *py, int n, int max, int *iters) {
+    renderJob job = {
+        .kind = TASK_POINTS,
+        .max = max,
+        .px = px,
+        .py = py,
+        .out = iters,
+        .num_points = n,
+        .num_tasks = (n + POINT_CHUNK - 1) / POINT_CHUNK,
+    };
+    dispatch(pool, &job);
+}
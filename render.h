@@ -0,0 +1,109 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "jpegrw.h"
+#include "palette.h"
+#include "perturb.h"
+
+// What compute_image did to produce a frame
+typedef struct renderStats {
+	long pixels_skipped;    // filled by solid fill without iterating
+	long pixels_mirrored;   // copied from their mirror image across the real axis
+} renderStats;
+
+// a persistent set of worker threads that share the rows of each frame
+typedef struct renderPool renderPool;
+
+// starts numThreads-1 helper threads, the calling thread is the last worker
+// returns NULL on failure
+renderPool* initRenderPool(int numThreads);
+
+void freeRenderPool(renderPool* pool);
+
+int renderPoolThreads(const renderPool* pool);
+
+// Pin thread t of the pool to core cpus[t] - the calling thread, which
+// works as thread 0, included. Returns 0 on success.
+int pinRenderPool(renderPool* pool, const int* cpus);
+
+// Turn Mariani-Silver solid fill on or off (off by default). Rectangles whose
+// whole border has one iteration count are filled without iterating the
+// inside. Much faster on frames with large flat areas, but a detail that
+// doesn't touch a border can be missed. Call before rendering starts.
+void setSolidFill(int enabled);
+
+// Turn the real-axis symmetry on or off (on by default). The rows of a
+// frame crossing the axis are shifted by at most a quarter row to line up
+// with their mirror images, which can move a boundary pixel, and the rows
+// below the axis that mirror a row above it are copied. Off iterates every
+// row where it is. Call before rendering starts.
+void setMirror(int enabled);
+
+// Compute an entire Mandelbrot image, writing each point to the given bitmap.
+// Scale the image to the range (xmin-xmax,ymin-ymax), limiting iterations to "max".
+// Colors come from the palette, which must have been built for the same max.
+// The rows are split across the pool's threads - pool may be NULL to run on
+// the calling thread alone. stats may be NULL.
+void compute_image(renderPool* pool, imgRawImage* img, double xmin, double xmax,
+				   double ymin, double ymax, int max, const colorPalette* palette,
+				   renderStats* stats);
+
+// compute_image for zooms past double precision. The frame is centered on the
+// reference orbit's point and spans xspan by yspan, every pixel is iterated
+// as a perturbation of the reference.
+void compute_image_perturbed(renderPool* pool, imgRawImage* img, const refOrbit* ref,
+							 double xspan, double yspan, int max, const colorPalette* palette,
+							 renderStats* stats);
+
+// The kernel stage on its own: the count of pixel (i,j) is stored in
+// counts[j*width+i], with row 0 at ymin. compute_image is this followed
+// by colorize_counts. When the frame crosses the real axis, its rows are
+// lined up with their mirror images and the rows below it that mirror a
+// row above it are copied rather than iterated.
+void compute_counts(renderPool* pool, int* counts, int width, int height, double xmin, double xmax,
+					double ymin, double ymax, int max, renderStats* stats);
+
+// The pixel coordinates compute_counts iterates: x of column i in cx[i],
+// y of row j in cy[j] - for other iterators, such as the GPU kernel, to
+// give the same counts
+void compute_coords(int width, int height, double xmin, double xmax, double ymin, double ymax,
+					double* cx, double* cy);
+
+// compute_counts with the float kernel, for frames planPrecision() says
+// don't need double
+void compute_counts_float(renderPool* pool, int* counts, int width, int height, double xmin, double xmax,
+						  double ymin, double ymax, int max, renderStats* stats);
+
+// the kernel stage of compute_image_perturbed
+void compute_counts_perturbed(renderPool* pool, int* counts, int width, int height, const refOrbit* ref,
+							  double xspan, double yspan, int max, renderStats* stats);
+
+// iterate the n points (px[k],py[k]) on the pool's threads
+void compute_points(renderPool* pool, const double* px, const double* py, int n, int max, int* iters);
+
+// Progressive rendering for fast previews: the counts are filled in levels,
+// every PROGRESSIVE_FIRST_STRIDE-th pixel of every such row first, then the
+// stride halves down to 1. Each level only iterates the pixels the coarser
+// ones haven't, and the final counts are exactly those of compute_counts
+// (or compute_counts_perturbed when ref isn't NULL - xmin..ymax are then the
+// offsets from the reference, -xspan/2 to xspan/2). level_done, if not NULL,
+// is called after each level with its stride, and may exit to cancel.
+#define PROGRESSIVE_FIRST_STRIDE 4
+
+typedef void (*progressLevelFn)(void* context, const int* counts, int stride);
+
+void compute_counts_progressive(renderPool* pool, int* counts, int width, int height, double xmin, double xmax,
+								double ymin, double ymax, const refOrbit* ref, int max,
+								progressLevelFn level_done, void* context);
+
+// Color the pixels of one progressive level - full frame counts sampled at
+// every stride-th pixel - into img, which must be width/stride by
+// height/stride pixels, rounded up
+void colorize_level(renderPool* pool, imgRawImage* img, const int* counts, int width, int stride,
+					const colorPalette* palette);
+
+// The colorize stage: map a buffer of counts laid out like compute_counts
+// through the palette into the image
+void colorize_counts(renderPool* pool, imgRawImage* img, const int* counts, const colorPalette* palette);
+
+#endif  /* Compile guard */